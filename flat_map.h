@@ -0,0 +1,166 @@
+#ifndef __FLAT_MAP_H
+#define __FLAT_MAP_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "strview.h"
+
+
+// Orders std::string, strview_t and C string keys alike, byte-wise like std::string::compare,
+// so a lookup by any of them needs no key object. Other key types use operator <.
+struct flat_map_less_t
+{
+  typedef void is_transparent;
+
+  template< class A, class B >
+  bool operator() ( const A& a, const B& b ) const { return less_( view_( a ), view_( b ) ); }
+
+private:
+  static strview_t view_( const std::string& s ) { return strview_t( s.data(), s.size() ); }
+  static strview_t view_( const strview_t& s ) { return s; }
+  static strview_t view_( const char* s ) { return strview_t( s ); }
+  template< size_t N >
+  static strview_t view_( const char (&s)[N] ) { return strview_t( s ); }
+  template< class T >
+  static const T& view_( const T& v ) { return v; }
+
+  static bool less_( const strview_t& a, const strview_t& b )
+  {
+    size_t n = a.size() < b.size() ? a.size() : b.size();
+    int c = n ? MEMCMP( a.data(), b.data(), n ) : 0;
+    return c < 0 || (0 == c && a.size() < b.size());
+  }
+  template< class T >
+  static bool less_( const T& a, const T& b ) { return a < b; }
+};
+
+// Map over a sorted vector: one allocation, binary search lookups, in order iteration.
+// For read-mostly data; an insert in the middle moves the items after it.
+template< class K, class V, class C = flat_map_less_t >
+struct flat_map_t
+{
+  typedef K key_type;
+  typedef V mapped_type;
+  typedef std::pair<K, V> value_type;
+  typedef typename std::vector<value_type>::iterator iterator;
+  typedef typename std::vector<value_type>::const_iterator const_iterator;
+
+  flat_map_t() {}
+
+  size_t size() const  { return v.size(); }
+  bool   empty() const { return v.empty(); }
+  void   clear()       { v.clear(); }
+  void   reserve( size_t n ) { v.reserve( n ); }
+
+  iterator       begin()       { return v.begin(); }
+  iterator       end()         { return v.end(); }
+  const_iterator begin() const { return v.begin(); }
+  const_iterator end() const   { return v.end(); }
+
+  template< class Q >
+  iterator lower_bound( const Q& k ) { return std::lower_bound( v.begin(), v.end(), k, key_less_() ); }
+  template< class Q >
+  const_iterator lower_bound( const Q& k ) const { return std::lower_bound( v.begin(), v.end(), k, key_less_() ); }
+
+  template< class Q >
+  iterator find( const Q& k )
+  {
+    iterator i = lower_bound( k );
+    return (i != v.end() && !C()( k, i->first )) ? i : v.end();
+  }
+  template< class Q >
+  const_iterator find( const Q& k ) const
+  {
+    const_iterator i = lower_bound( k );
+    return (i != v.end() && !C()( k, i->first )) ? i : v.end();
+  }
+  template< class Q >
+  size_t count( const Q& k ) const { return find( k ) != v.end() ? 1 : 0; }
+
+  template< class Q >
+  V& at( const Q& k )
+  {
+    iterator i = find( k );
+    if( i == v.end() )
+      throw std::string("flat_map_t: no such key");
+    return i->second;
+  }
+  template< class Q >
+  const V& at( const Q& k ) const
+  {
+    const_iterator i = find( k );
+    if( i == v.end() )
+      throw std::string("flat_map_t: no such key");
+    return i->second;
+  }
+
+  V& operator [] ( const K& k )
+  {
+    iterator i = lower_bound( k );
+    if( i == v.end() || C()( k, i->first ) )
+      i = v.insert( i, value_type( k, V() ) );
+    return i->second;
+  }
+
+  template< class... A >
+  std::pair<iterator, bool> emplace( A&&... _a )
+  {
+    value_type x( std::forward<A>(_a)... );
+    iterator i = lower_bound( x.first );
+    if( i != v.end() && !C()( x.first, i->first ) )
+      return std::make_pair( i, false );
+    return std::make_pair( v.insert( i, std::move(x) ), true );
+  }
+  std::pair<iterator, bool> insert( const value_type& _x ) { return emplace( _x ); }
+  std::pair<iterator, bool> insert( value_type&& _x ) { return emplace( std::move(_x) ); }
+
+  iterator erase( const_iterator i ) { return v.erase( i ); }
+  template< class Q >
+  size_t erase( const Q& k )
+  {
+    iterator i = find( k );
+    if( i == v.end() )
+      return 0;
+    v.erase( i );
+    return 1;
+  }
+
+  // Bulk load: append in any order, then sort() once before the next lookup. A later duplicate wins.
+  template< class... A >
+  value_type& emplace_back_unsorted( A&&... _a )
+  {
+    v.emplace_back( std::forward<A>(_a)... );
+    return v.back();
+  }
+  void sort()
+  {
+    std::stable_sort( v.begin(), v.end(), item_less_() );
+    // of each run of equal keys keep the last
+    size_t o = 0;
+    for( size_t i = 0; i < v.size(); ++i ) {
+      if( i + 1 < v.size() && !C()( v[i].first, v[i + 1].first ) )
+        continue;
+      if( o != i )
+        v[o] = std::move(v[i]);
+      ++o;
+    }
+    v.erase( v.begin() + o, v.end() );
+  }
+
+private:
+  std::vector<value_type> v;
+
+  struct key_less_
+  {
+    template< class Q >
+    bool operator() ( const value_type& a, const Q& k ) const { return C()( a.first, k ); }
+  };
+  struct item_less_
+  {
+    bool operator() ( const value_type& a, const value_type& b ) const { return C()( a.first, b.first ); }
+  };
+};
+
+
+#endif // __FLAT_MAP_H
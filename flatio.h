@@ -0,0 +1,1047 @@
+#ifndef __FLATIO_H
+#define __FLATIO_H
+
+#include "jsonio.h"
+
+
+// Flat snapshots of what serialize() describes, read in place with no parse step, e.g. straight from
+// a json_file_map_t mapping (jsonio_file.h):
+//   std::string buf; flat_write( buf, v );
+//   flat_view_t<T> fv( buf ); double p = fv.get<double>("price"); strview_t s = fv.get<strview_t>("name");
+//   flat_read( buf, v ); // or copy it all back into a T
+// Every type gets a table: members in serialize() order at fixed offsets, numbers, enums, char[N] and
+// nested objects inline. Strings, Bin fields, arrays and maps are an (offset, count) pair pointing at
+// their items further on. Byte order is the machine's; the header carries a hash of the whole layout,
+// so a snapshot written by a different version of the types is refused rather than misread.
+
+/////////////////////////////////////////////////////////// layout /////////////////////////////////////////////////////////////
+// names a type for the overloads below; found by ADL even for std types
+template< class T > struct flat_of_ {};
+
+struct flat_type_t
+{
+  uint32_t size;
+  uint32_t align;
+  uint32_t code; // what is stored, for the layout hash
+};
+static inline flat_type_t flat_type_make_( size_t _size, size_t _align, uint32_t _code )
+{
+  flat_type_t t = { (uint32_t)_size, (uint32_t)_align, _code };
+  return t;
+}
+static inline uint32_t flat_mix_( uint32_t a, uint32_t b )
+{
+  uint32_t h = (a ^ b) * 0x9e3779b1u;
+  return h ^ (h >> 15);
+}
+
+// strings, Bin fields, arrays and maps
+struct flat_ref_t
+{
+  uint32_t off; // from the start of the snapshot
+  uint32_t n;   // bytes or items
+};
+static inline flat_type_t flat_ref_type_( uint32_t _code ) { return flat_type_make_( sizeof(flat_ref_t), 4, _code ); }
+
+struct flat_member_t
+{
+  std::string name;
+  uint32_t offset;
+  flat_type_t type;
+};
+
+struct flat_layout_t
+{
+  std::vector<flat_member_t> members;
+  uint32_t size; // of a table, a multiple of 8
+  uint32_t hash; // names, offsets and types of the members, nested types included
+
+  flat_layout_t() : size(0), hash(2166136261u) {}
+
+  void add( const strview_t& _n, const flat_type_t& _t )
+  {
+    const uint32_t a = _t.align ? _t.align : 1;
+    flat_member_t m;
+    m.name.assign( _n.data(), _n.size() );
+    m.offset = (size + a - 1) & ~(a - 1);
+    m.type = _t;
+    members.push_back( m );
+    size = m.offset + _t.size;
+    hash = flat_mix_( flat_mix_( flat_mix_( hash ^ json_hash_( _n.data(), _n.size() ), m.offset ), _t.size ), _t.code );
+  }
+  void finish() { size = (size + 7) & ~7u; }
+
+  const flat_member_t* find( const strview_t& _n ) const
+  {
+    for( const flat_member_t& m : members ) {
+      if( _n.equal( m.name ) )
+        return &m;
+    }
+    return nullptr;
+  }
+  // member _n, which a view reads as _t
+  const flat_member_t& at( const strview_t& _n, const flat_type_t& _t ) const
+  {
+    const flat_member_t* m = find( _n );
+    if( !m )
+      throw std::string("flat: no member ") + std::string( _n.data(), _n.size() );
+    if( m->type.size != _t.size || m->type.code != _t.code )
+      throw std::string("flat: member ") + m->name + " is not of that type";
+    return *m;
+  }
+
+  template< class T > static const flat_layout_t& of();
+  template< class T > static flat_type_t object();
+  template< class T > static uint32_t item();
+
+private:
+  template< class T > void visit_();
+  // array levels the hash still looks through on this thread: items further down count as 'o'
+  enum { item_depth = 4 };
+  static int& depth_()
+  {
+    static thread_local int d = item_depth;
+    return d;
+  }
+};
+
+// Bin, Flags and BitFields fields: XioFunc<F, tag>
+struct flat_bytes_t {};
+struct flat_flags_t {};
+struct flat_bits_t {};
+template< class F, class T > struct flat_io_ { typedef F type; };
+template< class T > struct flat_io_<void, T> { typedef T type; };
+
+struct FlatOut;
+struct FlatIn;
+
+// T::serialize or xio<T>::serialize, for a T or const T _v
+template< class T, class S, class V >
+static inline void flat_serialize_( S& s, V& _v, decltype( &T::template serialize<FlatOut,T> ) _dummy ) { T::serialize( s, _v ); }
+template< class T, class S, class V >
+static inline void flat_serialize_( S& s, V& _v, decltype( &xio<T>::template serialize<FlatOut,T> ) _dummy ) { xio<T>::serialize( s, _v ); }
+
+// arithmetic types and enums as they are
+template< class T >
+static inline typename std::enable_if< std::is_arithmetic<T>::value || std::is_enum<T>::value, flat_type_t >::type flat_type_( flat_of_<T>, int _dummy )
+{
+  const uint32_t kind = std::is_floating_point<T>::value ? 'f' : std::is_signed<T>::value ? 'i' : 'u';
+  return flat_type_make_( sizeof(T), alignof(T) < 8 ? alignof(T) : 8, flat_mix_( kind, sizeof(T) ) );
+}
+template< class T >
+static inline typename std::enable_if< json_is_str_<T>::value || std::is_same<T, JsonOutBinX>::value, flat_type_t >::type flat_type_( flat_of_<T>, int _dummy )
+{
+  return flat_ref_type_( 's' );
+}
+template< size_t N >
+static inline flat_type_t flat_type_( flat_of_<char [N]>, int _dummy )
+{
+  return flat_type_make_( N, 1, flat_mix_( 'c', N ) );
+}
+template< size_t N >
+static inline flat_type_t flat_type_( flat_of_< std::bitset<N> >, int _dummy )
+{
+  return flat_type_make_( (N + 7) / 8, 1, flat_mix_( 'B', N ) );
+}
+// objects inline
+template< class T >
+static inline flat_type_t flat_type_( flat_of_<T>, decltype( &T::template serialize<FlatOut,T> ) _dummy ) { return flat_layout_t::object<T>(); }
+template< class T >
+static inline flat_type_t flat_type_( flat_of_<T>, decltype( &xio<T>::template serialize<FlatOut,T> ) _dummy ) { return flat_layout_t::object<T>(); }
+// anything else as the text xio<T> writes
+template< class T >
+static inline flat_type_t flat_type_( flat_of_<T>, ... )
+{
+  return flat_ref_type_( 't' );
+}
+
+// items of arrays and maps: objects by their layout one array level down, so a type reached
+// through its own items does not recurse
+template< class T >
+static inline uint32_t flat_item_code_( flat_of_<T>, decltype( &T::template serialize<FlatOut,T> ) _dummy ) { return flat_layout_t::item<T>(); }
+template< class T >
+static inline uint32_t flat_item_code_( flat_of_<T>, decltype( &xio<T>::template serialize<FlatOut,T> ) _dummy ) { return flat_layout_t::item<T>(); }
+template< class T >
+static inline uint32_t flat_item_code_( flat_of_<T>, ... ) { return flat_type_( flat_of_<T>(), 0 ).code; }
+
+template< class T >
+static inline flat_type_t flat_array_type_() { return flat_ref_type_( flat_mix_( 'a', flat_item_code_( flat_of_<T>(), 0 ) ) ); }
+template< class T, class A >
+static inline flat_type_t flat_type_( flat_of_< std::vector<T, A> >, int _dummy ) { return flat_array_type_<T>(); }
+template< class T, class A >
+static inline flat_type_t flat_type_( flat_of_< std::list<T, A> >, int _dummy ) { return flat_array_type_<T>(); }
+template< class T, size_t N >
+static inline flat_type_t flat_type_( flat_of_< small_vector_t<T, N> >, int _dummy ) { return flat_array_type_<T>(); }
+template< class T, size_t N >
+static inline flat_type_t flat_type_( flat_of_< std::array<T, N> >, int _dummy ) { return flat_array_type_<T>(); }
+template< class T, size_t N >
+static inline typename std::enable_if< !std::is_same<T, char>::value, flat_type_t >::type flat_type_( flat_of_<T [N]>, int _dummy ) { return flat_array_type_<T>(); }
+
+// a map is an array of entries sorted by key: the key, then the value at *_voff
+static inline flat_type_t flat_entry_type_( const flat_type_t& k, const flat_type_t& v, uint32_t* _voff )
+{
+  const uint32_t a = k.align > v.align ? k.align : v.align;
+  *_voff = (k.size + v.align - 1) & ~(v.align - 1);
+  return flat_type_make_( (*_voff + v.size + a - 1) & ~(a - 1), a, flat_mix_( k.code, v.code ) );
+}
+template< class K, class V >
+static inline flat_type_t flat_entry_type_( uint32_t* _voff )
+{
+  return flat_entry_type_( flat_type_( flat_of_<K>(), 0 ), flat_type_( flat_of_<V>(), 0 ), _voff );
+}
+template< class K, class V >
+static inline flat_type_t flat_map_type_()
+{
+  return flat_ref_type_( flat_mix_( 'm', flat_mix_( flat_item_code_( flat_of_<K>(), 0 ), flat_item_code_( flat_of_<V>(), 0 ) ) ) );
+}
+template< class K, class V, class C, class A >
+static inline flat_type_t flat_type_( flat_of_< std::map<K, V, C, A> >, int _dummy ) { return flat_map_type_<K, V>(); }
+template< class K, class V, class H, class E, class A >
+static inline flat_type_t flat_type_( flat_of_< std::unordered_map<K, V, H, E, A> >, int _dummy ) { return flat_map_type_<K, V>(); }
+template< class K, class V, class C >
+static inline flat_type_t flat_type_( flat_of_< flat_map_t<K, V, C> >, int _dummy ) { return flat_map_type_<K, V>(); }
+
+// Runs serialize() on a default T and records where each member goes
+struct FlatLayout
+{
+  flat_layout_t& l;
+  FlatLayout( flat_layout_t& _l ) : l(_l) {}
+
+  template< class T >
+  static JsonOutBinX Bin(const T& _v) { return JsonOutBinX(_v); }
+  static XioFunc<void, flat_bytes_t> Bin() { return XioFunc<void, flat_bytes_t>(); }
+  template< class T >
+  static JsonOutBinX Base64(const T& _v) { return JsonOutBinX(_v); }
+  static XioFunc<void, flat_bytes_t> Base64() { return XioFunc<void, flat_bytes_t>(); }
+  template< class T >
+  static JsonOutBinX Base64Url(const T& _v) { return JsonOutBinX(_v); }
+  static XioFunc<void, flat_bytes_t> Base64Url() { return XioFunc<void, flat_bytes_t>(); }
+  template< class F >
+  static XioFunc<F, flat_flags_t> Flags(F _f) { return XioFunc<F, flat_flags_t>(); }
+  static XioFunc<void, flat_flags_t> Flags() { return XioFunc<void, flat_flags_t>(); }
+  template< class F >
+  static XioFunc<F, flat_bits_t> BitFields(F _f) { return XioFunc<F, flat_bits_t>(); }
+  static XioFunc<void, flat_bits_t> BitFields() { return XioFunc<void, flat_bits_t>(); }
+
+  template< class T > void operator() ( const json_key_t& _n, const T& _v )
+  {
+    l.add( _n.name, flat_type_( flat_of_<T>(), 0 ) );
+  }
+  template< class T, class F > void operator() ( const json_key_t& _n, const T& _v, XioFunc<F, flat_bytes_t> _f )
+  {
+    l.add( _n.name, flat_ref_type_( 's' ) );
+  }
+  template< class T, class F > void operator() ( const json_key_t& _n, const T& _v, XioFunc<F, flat_flags_t> _f )
+  {
+    l.add( _n.name, flat_type_make_( 8, 8, 'F' ) );
+  }
+  template< class T, class F > void operator() ( const json_key_t& _n, const T& _v, XioFunc<F, flat_bits_t> _f )
+  {
+    l.add( _n.name, flat_ref_type_( 'b' ) );
+  }
+  template< class T, class X > void operator() ( const json_key_t& _n, const T& _v, xio<X> _f )
+  {
+    l.add( _n.name, flat_ref_type_( 't' ) );
+  }
+};
+
+template< class T >
+void flat_layout_t::visit_()
+{
+  FlatLayout fl( *this );
+  T v;
+  flat_serialize_<T>( fl, v, 0 );
+  finish();
+}
+// Built once per type. Nothing under it calls of<>() again except for objects held inline, which cannot
+// nest back into themselves, and the hash depends on T alone, not on which type was asked for first.
+template< class T >
+const flat_layout_t& flat_layout_t::of()
+{
+  struct build_t
+  {
+    flat_layout_t l;
+    build_t() { l.visit_<T>(); }
+  };
+  static const build_t b;
+  return b.l;
+}
+// an object inline: from of<>() at the top, laid out again under an array
+template< class T >
+flat_type_t flat_layout_t::object()
+{
+  if( item_depth == depth_() ) {
+    const flat_layout_t& l = of<T>();
+    return flat_type_make_( l.size, 8, l.hash );
+  }
+  flat_layout_t l;
+  l.visit_<T>();
+  return flat_type_make_( l.size, 8, l.hash );
+}
+template< class T >
+uint32_t flat_layout_t::item()
+{
+  int& d = depth_();
+  if( 0 == d )
+    return 'o';
+  --d;
+  flat_layout_t l;
+  try { l.visit_<T>(); } catch( ... ) { ++d; throw; }
+  ++d;
+  return l.hash;
+}
+
+
+/////////////////////////////////////////////////////////// FlatOut /////////////////////////////////////////////////////////////
+enum { flat_header_size = 16 };
+static const char flat_magic[4] = { 'F', 'L', 'T', '1' };
+
+struct flat_flags_out_t
+{
+  uint64_t mask;
+  size_t k;
+  flat_flags_out_t() : mask(0), k(0) {}
+  void set( bool _v )
+  {
+    if( k >= 64 )
+      throw std::string("flat: more than 64 flags");
+    if( _v ) mask |= (uint64_t)1 << k;
+    ++k;
+  }
+  template< class T >
+  void operator () ( const json_key_t& _n, T _v, T _bit ) { set( 0 != (_v & _bit) ); }
+  template< class T, class Fi >
+  void operator() ( const json_key_t& _n, T _v, Fi _fin ) { set( !!_v ); }
+};
+
+struct flat_bits_out_t
+{
+  small_vector_t<uint32_t, 16> v;
+  template< class T >
+  void operator () ( const json_key_t& _n, T _v, T _bit ) { v.push_back( (unsigned)!!(_v & _bit) ); }
+  template< class T, class Fi >
+  void operator() ( const json_key_t& _n, T _v, Fi _fin ) { v.push_back( (unsigned)_v ); }
+};
+
+// Fills the table at `t` of a snapshot starting at `base` of x; what is out of line is appended to x.
+struct FlatOut
+{
+  std::string& x;
+  size_t base;
+  size_t t;
+  const flat_layout_t& l;
+  size_t k; // next member
+
+  FlatOut( std::string& _x, size_t _base, size_t _t, const flat_layout_t& _l ) : x(_x), base(_base), t(_t), l(_l), k(0) {}
+
+  template< class T >
+  static JsonOutBinX Bin(const T& _v) { return JsonOutBinX(_v); }
+  static XioFunc<void, flat_bytes_t> Bin() { return XioFunc<void, flat_bytes_t>(); }
+  template< class T >
+  static JsonOutBinX Base64(const T& _v) { return JsonOutBinX(_v); }
+  static XioFunc<void, flat_bytes_t> Base64() { return XioFunc<void, flat_bytes_t>(); }
+  template< class T >
+  static JsonOutBinX Base64Url(const T& _v) { return JsonOutBinX(_v); }
+  static XioFunc<void, flat_bytes_t> Base64Url() { return XioFunc<void, flat_bytes_t>(); }
+  template< class F >
+  static XioFunc<F, flat_flags_t> Flags(F _f) { return XioFunc<F, flat_flags_t>(); }
+  static XioFunc<void, flat_flags_t> Flags() { return XioFunc<void, flat_flags_t>(); }
+  template< class F >
+  static XioFunc<F, flat_bits_t> BitFields(F _f) { return XioFunc<F, flat_bits_t>(); }
+  static XioFunc<void, flat_bits_t> BitFields() { return XioFunc<void, flat_bits_t>(); }
+
+  // n bytes aligned from the start of the snapshot, zeroed, at the end of x
+  size_t alloc( size_t n, size_t align )
+  {
+    const size_t off = base + ((x.size() - base + align - 1) & ~(align - 1));
+    if( off + n - base > 0xffffffffu )
+      throw std::string("flat: snapshot over 4 GB");
+    x.resize( off + n );
+    return off;
+  }
+  template< class T >
+  void put( size_t slot, const T& _v ) { memcpy( &x[slot], &_v, sizeof(T) ); }
+  void put_ref( size_t slot, size_t off, size_t n )
+  {
+    if( n > 0xffffffffu )
+      throw std::string("flat: too many items");
+    flat_ref_t r = { (uint32_t)(off - base), (uint32_t)n };
+    put( slot, r );
+  }
+  void put_bytes( size_t slot, const void* _data, size_t n )
+  {
+    const size_t off = alloc( n, 1 );
+    if( n )
+      memcpy( &x[off], _data, n );
+    put_ref( slot, off, n );
+  }
+
+  // members normally come in layout order
+  size_t slot( const json_key_t& _n )
+  {
+    const flat_member_t* m = (k < l.members.size() && _n.name.equal( l.members[k].name )) ? &l.members[k] : l.find( _n.name );
+    if( !m )
+      throw std::string("flat: member not in the layout");
+    k = m - l.members.data() + 1;
+    return t + m->offset;
+  }
+
+  template< class T > void operator() ( const json_key_t& _n, const T& _v )
+  {
+    flat_write_( *this, slot( _n ), _v, 0 );
+  }
+  template< class T, class F > void operator() ( const json_key_t& _n, const T& _v, XioFunc<F, flat_bytes_t> _f )
+  {
+    put_bytes( slot( _n ), _v.data(), _v.size() );
+  }
+  template< class T, class F > void operator() ( const json_key_t& _n, T& _v, XioFunc<F, flat_flags_t> _f )
+  {
+    flat_flags_out_t fo;
+    flat_io_<F, T>::type::serialize( fo, _v );
+    put( slot( _n ), fo.mask );
+  }
+  template< class T, class F > void operator() ( const json_key_t& _n, T& _v, XioFunc<F, flat_bits_t> _f )
+  {
+    flat_bits_out_t bo;
+    flat_io_<F, T>::type::serialize( bo, _v );
+    put_bytes( slot( _n ), bo.v.data(), bo.v.size() * sizeof(uint32_t) );
+  }
+  template< class T, class X > void operator() ( const json_key_t& _n, const T& _v, xio<X> _f )
+  {
+    std::string tmp;
+    X::Write( tmp, _v );
+    put_bytes( slot( _n ), tmp.data(), tmp.size() );
+  }
+};
+
+template< class T >
+static inline typename std::enable_if< std::is_arithmetic<T>::value || std::is_enum<T>::value >::type flat_write_( FlatOut& o, size_t slot, const T& _v, int _dummy )
+{
+  o.put( slot, _v );
+}
+template< class T >
+static inline typename std::enable_if< json_is_str_<T>::value >::type flat_write_( FlatOut& o, size_t slot, const T& _v, int _dummy )
+{
+  strview_t s(_v);
+  o.put_bytes( slot, s.data(), s.size() );
+}
+template< class T >
+static inline typename std::enable_if< std::is_same<T, JsonOutBinX>::value >::type flat_write_( FlatOut& o, size_t slot, const T& _v, int _dummy )
+{
+  o.put_bytes( slot, _v.data(), _v.size() );
+}
+template< size_t N >
+static inline void flat_write_( FlatOut& o, size_t slot, const char (&_v)[N], int _dummy )
+{
+  memcpy( &o.x[slot], _v, strnlen( _v, N ) );
+}
+template< size_t N >
+static inline void flat_write_( FlatOut& o, size_t slot, const std::bitset<N>& _v, int _dummy )
+{
+  for( size_t i = 0; i < N; ++i ) {
+    if( _v[i] )
+      o.x[slot + i / 8] |= (char)(1 << (i % 8));
+  }
+}
+template< class T >
+static inline void flat_write_( FlatOut& o, size_t slot, const T& _v, decltype( &T::template serialize<FlatOut,T> ) _dummy )
+{
+  FlatOut fo( o.x, o.base, slot, flat_layout_t::of<T>() );
+  T::serialize( fo, _v );
+}
+template< class T >
+static inline void flat_write_( FlatOut& o, size_t slot, const T& _v, decltype( &xio<T>::template serialize<FlatOut,T> ) _dummy )
+{
+  FlatOut fo( o.x, o.base, slot, flat_layout_t::of<T>() );
+  xio<T>::serialize( fo, _v );
+}
+template< class T >
+static inline void flat_write_( FlatOut& o, size_t slot, const T& _v, ... )
+{
+  std::string tmp;
+  xio<T>::Write( tmp, _v );
+  o.put_bytes( slot, tmp.data(), tmp.size() );
+}
+
+template< class T, class V >
+static inline void flat_write_items_( FlatOut& o, size_t slot, const V& _v, size_t n )
+{
+  const flat_type_t it = flat_type_( flat_of_<T>(), 0 );
+  const size_t off = o.alloc( n * it.size, it.align );
+  o.put_ref( slot, off, n );
+  size_t i = off;
+  for( const T& v : _v ) {
+    flat_write_( o, i, v, 0 );
+    i += it.size;
+  }
+}
+// numbers in one copy
+template< class T, class A >
+static inline typename std::enable_if< std::is_arithmetic<T>::value && !std::is_same<T, bool>::value >::type flat_write_( FlatOut& o, size_t slot, const std::vector<T, A>& _v, int _dummy )
+{
+  const size_t off = o.alloc( _v.size() * sizeof(T), alignof(T) < 8 ? alignof(T) : 8 );
+  if( !_v.empty() )
+    memcpy( &o.x[off], _v.data(), _v.size() * sizeof(T) );
+  o.put_ref( slot, off, _v.size() );
+}
+template< class T, class A >
+static inline typename std::enable_if< !std::is_arithmetic<T>::value || std::is_same<T, bool>::value >::type flat_write_( FlatOut& o, size_t slot, const std::vector<T, A>& _v, int _dummy )
+{
+  flat_write_items_<T>( o, slot, _v, _v.size() );
+}
+template< class T, class A >
+static inline void flat_write_( FlatOut& o, size_t slot, const std::list<T, A>& _v, int _dummy )
+{
+  flat_write_items_<T>( o, slot, _v, _v.size() );
+}
+template< class T, size_t N >
+static inline void flat_write_( FlatOut& o, size_t slot, const small_vector_t<T, N>& _v, int _dummy )
+{
+  flat_write_items_<T>( o, slot, _v, _v.size() );
+}
+template< class T, size_t N >
+static inline void flat_write_( FlatOut& o, size_t slot, const std::array<T, N>& _v, int _dummy )
+{
+  flat_write_items_<T>( o, slot, _v, N );
+}
+template< class T, size_t N >
+static inline typename std::enable_if< !std::is_same<T, char>::value >::type flat_write_( FlatOut& o, size_t slot, const T (&_v)[N], int _dummy )
+{
+  flat_write_items_<T>( o, slot, _v, N );
+}
+
+// entries go in key order, so views can binary search them
+template< class K, class V, class M >
+static inline void flat_write_map_( FlatOut& o, size_t slot, const M& _m )
+{
+  typedef typename M::value_type kv_t;
+  std::vector<const kv_t*> items;
+  items.reserve( _m.size() );
+  for( const kv_t& kv : _m )
+    items.push_back( &kv );
+  std::stable_sort( items.begin(), items.end(), [] (const kv_t* a, const kv_t* b) { return flat_map_less_t()( a->first, b->first ); } );
+  uint32_t voff;
+  const flat_type_t et = flat_entry_type_<K, V>( &voff );
+  const size_t off = o.alloc( items.size() * et.size, et.align );
+  o.put_ref( slot, off, items.size() );
+  size_t i = off;
+  for( const kv_t* kv : items ) {
+    flat_write_( o, i, kv->first, 0 );
+    flat_write_( o, i + voff, kv->second, 0 );
+    i += et.size;
+  }
+}
+template< class K, class V, class C, class A >
+static inline void flat_write_( FlatOut& o, size_t slot, const std::map<K, V, C, A>& _v, int _dummy )
+{
+  flat_write_map_<K, V>( o, slot, _v );
+}
+template< class K, class V, class H, class E, class A >
+static inline void flat_write_( FlatOut& o, size_t slot, const std::unordered_map<K, V, H, E, A>& _v, int _dummy )
+{
+  flat_write_map_<K, V>( o, slot, _v );
+}
+template< class K, class V, class C >
+static inline void flat_write_( FlatOut& o, size_t slot, const flat_map_t<K, V, C>& _v, int _dummy )
+{
+  flat_write_map_<K, V>( o, slot, _v );
+}
+
+// Appends a snapshot of _v to _out
+template< class T >
+static inline void flat_write( std::string& _out, const T& _v )
+{
+  const flat_layout_t& l = flat_layout_t::of<T>();
+  const size_t base = _out.size();
+  _out.resize( base + flat_header_size + l.size );
+  memcpy( &_out[base], flat_magic, 4 );
+  memcpy( &_out[base + 4], &l.hash, 4 );
+  {
+    FlatOut fo( _out, base, base + flat_header_size, l );
+    flat_serialize_<T>( fo, _v, 0 );
+  }
+  const uint64_t size = _out.size() - base;
+  memcpy( &_out[base + 8], &size, 8 );
+}
+
+
+/////////////////////////////////////////////////////////// FlatIn /////////////////////////////////////////////////////////////
+// bytes or items a reference in the snapshot [base, end) points at, checked to lie inside it
+static inline const char* flat_ref_at_( const char* base, const char* end, const char* slot, size_t _item, size_t* _n )
+{
+  flat_ref_t r;
+  memcpy( &r, slot, sizeof(r) );
+  if( r.off > (size_t)(end - base) || (uint64_t)r.n * _item > (uint64_t)(end - base - r.off) )
+    throw std::string("flat: reference out of bounds");
+  *_n = r.n;
+  return base + r.off;
+}
+static inline strview_t flat_bytes_at_( const char* base, const char* end, const char* slot )
+{
+  size_t n;
+  const char* p = flat_ref_at_( base, end, slot, 1, &n );
+  return strview_t( p, n );
+}
+
+// checks the header of a snapshot of the type with layout _l; returns the root table
+static inline const char* flat_root_( const strview_t& x, const flat_layout_t& _l, const char** _end )
+{
+  uint32_t hash;
+  uint64_t size;
+  if( x.size() < flat_header_size || 0 != MEMCMP( x.data(), flat_magic, 4 ) )
+    throw std::string("flat: not a snapshot");
+  memcpy( &hash, x.data() + 4, 4 );
+  memcpy( &size, x.data() + 8, 8 );
+  if( hash != _l.hash )
+    throw std::string("flat: snapshot of a different layout");
+  if( size > x.size() || size < flat_header_size + _l.size )
+    throw std::string("flat: snapshot truncated");
+  *_end = x.data() + size;
+  return x.data() + flat_header_size;
+}
+
+struct flat_flags_in_t
+{
+  uint64_t mask;
+  size_t k;
+  flat_flags_in_t( uint64_t _mask ) : mask(_mask), k(0) {}
+  bool get() { bool v = k < 64 && ((mask >> k) & 1); ++k; return v; }
+
+  template< class T >
+  void operator () ( const json_key_t& _n, T& _v, T _bit )
+  {
+    if( get() ) _v |= _bit; // set bit
+    else _v &= ~_bit; // clear bit
+  }
+  template< class T, class Fi >
+  void operator() ( const json_key_t& _n, const T& _v, Fi _fin ) { _fin( get() ); }
+};
+
+struct flat_bits_in_t
+{
+  const char* p;
+  size_t n;
+  size_t k;
+  flat_bits_in_t( const char* _p, size_t _n ) : p(_p), n(_n), k(0) {}
+  unsigned get()
+  {
+    uint32_t v = 0;
+    if( k < n )
+      memcpy( &v, p + k * sizeof(v), sizeof(v) );
+    ++k;
+    return v;
+  }
+
+  template< class T >
+  void operator () ( const json_key_t& _n, T& _v, T _bit )
+  {
+    if( get() ) _v |= _bit; // set bit
+    else _v &= ~_bit; // clear bit
+  }
+  template< class T, class Fi >
+  void operator() ( const json_key_t& _n, const T& _v, Fi _fin ) { _fin( get() ); }
+};
+
+// Copies a snapshot back into objects: the table at `t`, references checked against [base, end)
+struct FlatIn
+{
+  const char* base;
+  const char* end;
+  const char* t;
+  const flat_layout_t& l;
+  size_t k; // next member
+
+  FlatIn( const char* _base, const char* _end, const char* _t, const flat_layout_t& _l ) : base(_base), end(_end), t(_t), l(_l), k(0) {}
+
+  static JsonInBinS Bin(std::string& _v) { return JsonInBinS(_v); }
+  template< class T >
+  static JsonInBinX Bin(T& _v) { return JsonInBinX(_v); }
+  static XioFunc<void, flat_bytes_t> Bin() { return XioFunc<void, flat_bytes_t>(); }
+  static JsonInBinS Base64(std::string& _v) { return JsonInBinS(_v); }
+  template< class T >
+  static JsonInBinX Base64(T& _v) { return JsonInBinX(_v); }
+  static XioFunc<void, flat_bytes_t> Base64() { return XioFunc<void, flat_bytes_t>(); }
+  static JsonInBinS Base64Url(std::string& _v) { return JsonInBinS(_v); }
+  template< class T >
+  static JsonInBinX Base64Url(T& _v) { return JsonInBinX(_v); }
+  static XioFunc<void, flat_bytes_t> Base64Url() { return XioFunc<void, flat_bytes_t>(); }
+  template< class F >
+  static XioFunc<F, flat_flags_t> Flags(F _f) { return XioFunc<F, flat_flags_t>(); }
+  static XioFunc<void, flat_flags_t> Flags() { return XioFunc<void, flat_flags_t>(); }
+  template< class F >
+  static XioFunc<F, flat_bits_t> BitFields(F _f) { return XioFunc<F, flat_bits_t>(); }
+  static XioFunc<void, flat_bits_t> BitFields() { return XioFunc<void, flat_bits_t>(); }
+
+  const char* slot( const json_key_t& _n )
+  {
+    const flat_member_t* m = (k < l.members.size() && _n.name.equal( l.members[k].name )) ? &l.members[k] : l.find( _n.name );
+    if( !m )
+      throw std::string("flat: member not in the layout");
+    k = m - l.members.data() + 1;
+    return t + m->offset;
+  }
+  strview_t bytes( const json_key_t& _n ) { return flat_bytes_at_( base, end, slot( _n ) ); }
+
+  template< class T > void operator() ( const json_key_t& _n, T& _v )
+  {
+    flat_read_( *this, slot( _n ), _v, 0 );
+  }
+  void operator() ( const json_key_t& _n, JsonInBinS _v )
+  {
+    strview_t s = bytes( _n );
+    _v.v.assign( s.data(), s.size() );
+  }
+  void operator() ( const json_key_t& _n, JsonInBinX _v )
+  {
+    strview_t s = bytes( _n );
+    if( s.size() == _v.v_size ) // left as it was on a size mismatch
+      memcpy( _v.v_data, s.data(), s.size() );
+  }
+  template< class T, class F > void operator() ( const json_key_t& _n, T& _v, XioFunc<F, flat_bytes_t> _f )
+  {
+    strview_t s = bytes( _n );
+    _v.assign( s.data(), s.size() );
+  }
+  template< class T, class F > void operator() ( const json_key_t& _n, T& _v, XioFunc<F, flat_flags_t> _f )
+  {
+    uint64_t mask;
+    memcpy( &mask, slot( _n ), 8 );
+    flat_flags_in_t fi( mask );
+    flat_io_<F, T>::type::serialize( fi, _v );
+  }
+  template< class T, class F > void operator() ( const json_key_t& _n, T& _v, XioFunc<F, flat_bits_t> _f )
+  {
+    size_t n;
+    const char* p = flat_ref_at_( base, end, slot( _n ), sizeof(uint32_t), &n );
+    flat_bits_in_t bi( p, n );
+    flat_io_<F, T>::type::serialize( bi, _v );
+  }
+  template< class T, class X > void operator() ( const json_key_t& _n, T& _v, xio<X> _f )
+  {
+    strview_t s = bytes( _n );
+    X::Read( s, _v );
+  }
+};
+
+template< class T >
+static inline typename std::enable_if< std::is_arithmetic<T>::value || std::is_enum<T>::value >::type flat_read_( const FlatIn& in, const char* slot, T& _v, int _dummy )
+{
+  memcpy( &_v, slot, sizeof(T) );
+}
+template< class Tr, class A >
+static inline void flat_read_( const FlatIn& in, const char* slot, std::basic_string<char, Tr, A>& _v, int _dummy )
+{
+  strview_t s = flat_bytes_at_( in.base, in.end, slot );
+  _v.assign( s.data(), s.size() );
+}
+// points into the snapshot
+static inline void flat_read_( const FlatIn& in, const char* slot, strview_t& _v, int _dummy )
+{
+  _v = flat_bytes_at_( in.base, in.end, slot );
+}
+template< size_t N >
+static inline void flat_read_( const FlatIn& in, const char* slot, char (&_v)[N], int _dummy )
+{
+  memcpy( _v, slot, N );
+}
+template< size_t N >
+static inline void flat_read_( const FlatIn& in, const char* slot, std::bitset<N>& _v, int _dummy )
+{
+  for( size_t i = 0; i < N; ++i )
+    _v[i] = 0 != ((uint8_t)slot[i / 8] & (1 << (i % 8)));
+}
+template< class T >
+static inline void flat_read_( const FlatIn& in, const char* slot, T& _v, decltype( &T::template serialize<FlatIn,T> ) _dummy )
+{
+  FlatIn fi( in.base, in.end, slot, flat_layout_t::of<T>() );
+  T::serialize( fi, _v );
+}
+template< class T >
+static inline void flat_read_( const FlatIn& in, const char* slot, T& _v, decltype( &xio<T>::template serialize<FlatIn,T> ) _dummy )
+{
+  FlatIn fi( in.base, in.end, slot, flat_layout_t::of<T>() );
+  xio<T>::serialize( fi, _v );
+}
+template< class T >
+static inline void flat_read_( const FlatIn& in, const char* slot, T& _v, ... )
+{
+  strview_t s = flat_bytes_at_( in.base, in.end, slot );
+  xio<T>::Read( s, _v );
+}
+
+struct flat_count_t
+{
+  size_t n;
+  size_t count() const { return n; }
+};
+template< class T, class V >
+static inline void flat_read_list_( const FlatIn& in, const char* slot, V& _v )
+{
+  const size_t size = flat_type_( flat_of_<T>(), 0 ).size;
+  size_t n;
+  const char* p = flat_ref_at_( in.base, in.end, slot, size, &n );
+  _v.clear();
+  flat_count_t c = { n };
+  json_reserve_( c, _v, 0 );
+  for( size_t i = 0; i < n; ++i, p += size ) {
+    _v.emplace_back();
+    flat_read_( in, p, _v.back(), 0 );
+  }
+}
+template< class T, class A >
+static inline typename std::enable_if< std::is_arithmetic<T>::value && !std::is_same<T, bool>::value >::type flat_read_( const FlatIn& in, const char* slot, std::vector<T, A>& _v, int _dummy )
+{
+  size_t n;
+  const char* p = flat_ref_at_( in.base, in.end, slot, sizeof(T), &n );
+  _v.resize( n );
+  if( n )
+    memcpy( _v.data(), p, n * sizeof(T) );
+}
+template< class T, class A >
+static inline typename std::enable_if< !std::is_arithmetic<T>::value >::type flat_read_( const FlatIn& in, const char* slot, std::vector<T, A>& _v, int _dummy )
+{
+  flat_read_list_<T>( in, slot, _v );
+}
+template< class A >
+static inline void flat_read_( const FlatIn& in, const char* slot, std::vector<bool, A>& _v, int _dummy )
+{
+  size_t n;
+  const char* p = flat_ref_at_( in.base, in.end, slot, sizeof(bool), &n );
+  _v.resize( n );
+  for( size_t i = 0; i < n; ++i )
+    _v[i] = 0 != p[i];
+}
+template< class T, class A >
+static inline void flat_read_( const FlatIn& in, const char* slot, std::list<T, A>& _v, int _dummy )
+{
+  flat_read_list_<T>( in, slot, _v );
+}
+template< class T, size_t N >
+static inline void flat_read_( const FlatIn& in, const char* slot, small_vector_t<T, N>& _v, int _dummy )
+{
+  flat_read_list_<T>( in, slot, _v );
+}
+template< class T >
+static inline void flat_read_fixed_( const FlatIn& in, const char* slot, T* _v, size_t N )
+{
+  const size_t size = flat_type_( flat_of_<T>(), 0 ).size;
+  size_t n;
+  const char* p = flat_ref_at_( in.base, in.end, slot, size, &n );
+  if( n > N )
+    throw std::string("too many items for a fixed size array");
+  for( size_t i = 0; i < n; ++i, p += size )
+    flat_read_( in, p, _v[i], 0 );
+}
+template< class T, size_t N >
+static inline void flat_read_( const FlatIn& in, const char* slot, std::array<T, N>& _v, int _dummy )
+{
+  flat_read_fixed_( in, slot, _v.data(), N );
+}
+template< class T, size_t N >
+static inline typename std::enable_if< !std::is_same<T, char>::value >::type flat_read_( const FlatIn& in, const char* slot, T (&_v)[N], int _dummy )
+{
+  flat_read_fixed_( in, slot, _v, N );
+}
+
+template< class K, class V, class M >
+static inline void flat_read_map_( const FlatIn& in, const char* slot, M& _m )
+{
+  uint32_t voff;
+  const flat_type_t et = flat_entry_type_<K, V>( &voff );
+  size_t n;
+  const char* p = flat_ref_at_( in.base, in.end, slot, et.size, &n );
+  _m.clear();
+  for( size_t i = 0; i < n; ++i, p += et.size ) {
+    K k;
+    flat_read_( in, p, k, 0 );
+    flat_read_( in, p + voff, _m[std::move(k)], 0 );
+  }
+}
+template< class K, class V, class C, class A >
+static inline void flat_read_( const FlatIn& in, const char* slot, std::map<K, V, C, A>& _v, int _dummy )
+{
+  flat_read_map_<K, V>( in, slot, _v );
+}
+template< class K, class V, class H, class E, class A >
+static inline void flat_read_( const FlatIn& in, const char* slot, std::unordered_map<K, V, H, E, A>& _v, int _dummy )
+{
+  flat_read_map_<K, V>( in, slot, _v );
+}
+// already in key order
+template< class K, class V, class C >
+static inline void flat_read_( const FlatIn& in, const char* slot, flat_map_t<K, V, C>& _v, int _dummy )
+{
+  uint32_t voff;
+  const flat_type_t et = flat_entry_type_<K, V>( &voff );
+  size_t n;
+  const char* p = flat_ref_at_( in.base, in.end, slot, et.size, &n );
+  _v.clear();
+  _v.reserve( n );
+  for( size_t i = 0; i < n; ++i, p += et.size ) {
+    typename flat_map_t<K, V, C>::value_type& item = _v.emplace_back_unsorted();
+    flat_read_( in, p, item.first, 0 );
+    flat_read_( in, p + voff, item.second, 0 );
+  }
+  _v.sort();
+}
+
+// Reads a whole snapshot of T back
+template< class T >
+static inline void flat_read( const strview_t& _x, T& _v )
+{
+  const flat_layout_t& l = flat_layout_t::of<T>();
+  const char* end;
+  const char* t = flat_root_( _x, l, &end );
+  FlatIn fi( _x.data(), end, t, l );
+  flat_serialize_<T>( fi, _v, 0 );
+}
+
+
+/////////////////////////////////////////////////////////// views /////////////////////////////////////////////////////////////
+// Read in place: get<V>() takes the view type of a member. Numbers and enums as their own type,
+// strings and Bin fields as strview_t, objects as flat_view_t<T>, arrays as flat_array_t<item view>,
+// maps as flat_map_view_t<key view, value view>. Nothing is copied except numbers.
+template< class T > struct flat_view_t;
+template< class E > struct flat_array_t;
+template< class K, class V > struct flat_entry_t;
+template< class K, class V > struct flat_map_view_t;
+
+template< class T >
+static inline flat_type_t flat_type_( flat_of_< flat_view_t<T> >, int _dummy ) { return flat_type_( flat_of_<T>(), 0 ); }
+template< class T >
+static inline uint32_t flat_item_code_( flat_of_< flat_view_t<T> >, int _dummy ) { return flat_layout_t::item<T>(); }
+template< class E >
+static inline flat_type_t flat_type_( flat_of_< flat_array_t<E> >, int _dummy ) { return flat_array_type_<E>(); }
+template< class K, class V >
+static inline flat_type_t flat_type_( flat_of_< flat_map_view_t<K, V> >, int _dummy ) { return flat_map_type_<K, V>(); }
+template< class K, class V >
+static inline flat_type_t flat_type_( flat_of_< flat_entry_t<K, V> >, int _dummy ) { uint32_t voff; return flat_entry_type_<K, V>( &voff ); }
+
+template< class V >
+static inline typename std::enable_if< std::is_arithmetic<V>::value || std::is_enum<V>::value, V >::type flat_get_( const char* base, const char* bound, const char* slot, flat_of_<V> )
+{
+  V v;
+  memcpy( &v, slot, sizeof(V) );
+  return v;
+}
+static inline strview_t flat_get_( const char* base, const char* bound, const char* slot, flat_of_<strview_t> )
+{
+  return flat_bytes_at_( base, bound, slot );
+}
+template< class V >
+static inline typename std::enable_if< !std::is_arithmetic<V>::value && !std::is_enum<V>::value, V >::type flat_get_( const char* base, const char* bound, const char* slot, flat_of_<V> )
+{
+  return V( base, bound, slot );
+}
+
+template< class T >
+struct flat_view_t
+{
+  const char* base;
+  const char* bound;
+  const char* t;
+
+  flat_view_t() : base(nullptr), bound(nullptr), t(nullptr) {}
+  flat_view_t( const char* _base, const char* _bound, const char* _t ) : base(_base), bound(_bound), t(_t) {}
+  // a whole snapshot, its header checked against T
+  explicit flat_view_t( const strview_t& _x ) : base(_x.data()), bound(nullptr), t(flat_root_( _x, flat_layout_t::of<T>(), &bound )) {}
+
+  // for hot loops: look the member up once, then get<V>(m)
+  template< class V >
+  static const flat_member_t& member( const json_key_t& _n ) { return flat_layout_t::of<T>().at( _n.name, flat_type_( flat_of_<V>(), 0 ) ); }
+
+  template< class V >
+  V get( const flat_member_t& _m ) const { return flat_get_( base, bound, t + _m.offset, flat_of_<V>() ); }
+  template< class V >
+  V get( const json_key_t& _n ) const { return get<V>( member<V>( _n ) ); }
+};
+
+template< class E >
+struct flat_array_t
+{
+  const char* base;
+  const char* bound;
+  const char* p;
+  size_t n;
+  size_t stride;
+
+  flat_array_t() : base(nullptr), bound(nullptr), p(nullptr), n(0), stride(0) {}
+  flat_array_t( const char* _base, const char* _bound, const char* _slot ) : base(_base), bound(_bound), n(0), stride(flat_type_( flat_of_<E>(), 0 ).size)
+  {
+    p = flat_ref_at_( base, bound, _slot, stride, &n );
+  }
+
+  size_t size() const { return n; }
+  bool empty() const { return 0 == n; }
+  E operator [] ( size_t i ) const { ASSERT( i < n ); return flat_get_( base, bound, p + i * stride, flat_of_<E>() ); }
+  // numbers in place; aligned when the snapshot is, as a mapping is
+  const E* data() const
+  {
+    static_assert( std::is_arithmetic<E>::value || std::is_enum<E>::value, "flat_array_t::data() is for numbers" );
+    return (const E*)p;
+  }
+
+  struct iterator
+  {
+    const flat_array_t* a;
+    size_t i;
+    E operator * () const { return (*a)[i]; }
+    iterator& operator ++ () { ++i; return *this; }
+    bool operator != ( const iterator& _x ) const { return i != _x.i; }
+  };
+  iterator begin() const { iterator r = { this, 0 }; return r; }
+  iterator end() const { iterator r = { this, n }; return r; }
+};
+
+template< class K, class V >
+struct flat_entry_t
+{
+  const char* base;
+  const char* bound;
+  const char* p;
+  flat_entry_t( const char* _base, const char* _bound, const char* _p ) : base(_base), bound(_bound), p(_p) {}
+
+  K key() const { return flat_get_( base, bound, p, flat_of_<K>() ); }
+  V value() const
+  {
+    uint32_t voff;
+    flat_entry_type_<K, V>( &voff );
+    return flat_get_( base, bound, p + voff, flat_of_<V>() );
+  }
+};
+
+// Entries are in key order as flat_map_less_t sees it, which is how std::map and flat_map_t
+// with their default comparators hold them: find() is a binary search.
+template< class K, class V >
+struct flat_map_view_t : flat_array_t< flat_entry_t<K, V> >
+{
+  typedef flat_array_t< flat_entry_t<K, V> > base_t;
+  flat_map_view_t() {}
+  flat_map_view_t( const char* _base, const char* _bound, const char* _slot ) : base_t(_base, _bound, _slot) {}
+
+  bool find( const K& _k, V* _v ) const
+  {
+    size_t lo = 0, hi = this->n;
+    while( lo < hi ) {
+      size_t mid = lo + (hi - lo) / 2;
+      if( flat_map_less_t()( (*this)[mid].key(), _k ) )
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if( lo == this->n || flat_map_less_t()( _k, (*this)[lo].key() ) )
+      return false;
+    *_v = (*this)[lo].value();
+    return true;
+  }
+  V at( const K& _k ) const
+  {
+    V v;
+    if( !find( _k, &v ) )
+      throw std::string("flat: no such key");
+    return v;
+  }
+};
+
+
+#endif // __FLATIO_H
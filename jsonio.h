@@ -5,65 +5,193 @@
 #include <vector>
 #include <list>
 #include <map>
+#include <unordered_map>
+#include <tuple>
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <new>
+#include <type_traits>
+#include <limits>
+#include <cstdlib>
+#include <clocale>
+#include <cerrno>
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define JSONIO_TO_CHARS 1
+#endif
+#endif
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#if defined(__cpp_lib_memory_resource) && __cpp_lib_memory_resource >= 201603L
+#define JSONIO_PMR 1
+#endif
+#endif
+#endif
 #include "strview.h"
+#include "small_vector.h"
+#include "flat_map.h"
 
 template<class T> struct xio;
 
 
+struct x2s_dummy
+{
+  operator bool () const { return false; }
+  bool operator() ( ... ) { return false; }
+};
+
+// Hash of a short name on its length and first, middle and last char
+static inline size_t x2s_hash_( const strview_t& s )
+{
+  size_t n = s.size();
+  if( !n )
+    return 0;
+  uint32_t h = (uint32_t)n * 0x9e3779b1u ^ (uint8_t)s[0] * 0x85ebca77u ^ (uint8_t)s[n / 2] * 0xc2b2ae3du ^ (uint8_t)s[n - 1] * 0x27d4eb2fu;
+  return h ^ (h >> 15);
+}
+
+// Lookup tables built once per type from xio<T>::x2s_map_; the first entry wins for duplicate names or values.
+// Names hash with x2s_hash_; values index a direct array when dense, a hash otherwise.
 template<class T>
-struct x2s_by_str
+struct x2s_table_t
 {
-  bool x2s_found;
-  strview_t x2s_str;
-  T& x2s_result;
+  struct entry_t { T val; strview_t name; };
+  typedef std::integral_constant<bool, std::is_enum<T>::value || std::is_integral<T>::value> is_int_t;
 
-  x2s_by_str( strview_t _str, T* _out ) : x2s_found(false), x2s_str(_str), x2s_result(*_out) {}
-  operator bool () const { return x2s_found; }
-  template<size_t N>
-  bool operator() ( const T&& v, const char (&s)[N] )
+  std::vector<entry_t> entries;
+  std::vector<uint32_t> by_name; // entry index + 1, 0 - empty
+  std::vector<uint32_t> by_val;  // the same, at value - val_min when dense
+  long long val_min;
+  bool dense;
+
+  static const x2s_table_t& of()
   {
-    if( !x2s_found && x2s_str.equal(s) ) {
-      x2s_found = true;
-      x2s_result = v;
-      return true;
-    }
-    return false;
+    static const x2s_table_t t;
+    return t;
   }
-};
 
-template<class T, class Out>
-struct x2s_by_val
-{
-  bool x2s_found;
-  const T& x2s_val;
-  Out& x2s_result;
+  x2s_table_t() : val_min(0), dense(false)
+  {
+    xio<T>::x2s_map_( *this );
+    size_t cap = 4;
+    for( ; cap < entries.size() * 2; cap *= 2 ) {}
+    by_name.assign( cap, 0 );
+    for( size_t i = 0; i < entries.size(); ++i ) {
+      uint32_t& k = by_name[name_pos_( entries[i].name )];
+      if( !k ) k = (uint32_t)i + 1;
+    }
+    build_by_val_( is_int_t() );
+  }
 
-  x2s_by_val( const T& _val, Out* _out ) : x2s_found(false), x2s_val(_val), x2s_result(*_out) {}
-  operator bool () const { return x2s_found; }
+  // called by x2s_map_ for every entry
   template<size_t N>
   bool operator() ( const T& v, const char (&s)[N] )
   {
-    if( !x2s_found && x2s_val == v ) {
-      x2s_found = true;
-      x2s_result = s;
-      return true;
-    }
+    entry_t e = { v, strview_t( s, N - 1 ) };
+    entries.push_back( e );
     return false;
   }
-};
 
-struct x2s_dummy
-{
-  operator bool () const { return false; }
-  bool operator() ( ... ) { return false; }
+  const entry_t* find_name( const strview_t& _s ) const
+  {
+    uint32_t k = by_name[name_pos_( _s )];
+    return k ? &entries[k - 1] : nullptr;
+  }
+  const entry_t* find_value( const T& _v ) const { return find_value_( _v, is_int_t() ); }
+
+private:
+  static size_t hash_( const strview_t& s ) { return x2s_hash_( s ); }
+  static size_t hash_( long long v )
+  {
+    uint64_t h = (uint64_t)v * 0x9e3779b97f4a7c15ull;
+    return (size_t)(h >> 32);
+  }
+  static long long key_( const T& v ) { return (long long)v; }
+
+  // the slot holding _s or the empty one it would go to; the tables are never more than half full
+  size_t name_pos_( const strview_t& _s ) const
+  {
+    size_t mask = by_name.size() - 1;
+    for( size_t h = hash_( _s ) & mask; ; h = (h + 1) & mask ) {
+      uint32_t k = by_name[h];
+      if( !k || entries[k - 1].name.equal( _s.data(), _s.size() ) )
+        return h;
+    }
+  }
+  size_t val_pos_( long long _v ) const
+  {
+    size_t mask = by_val.size() - 1;
+    for( size_t h = hash_( _v ) & mask; ; h = (h + 1) & mask ) {
+      uint32_t k = by_val[h];
+      if( !k || key_( entries[k - 1].val ) == _v )
+        return h;
+    }
+  }
+
+  void build_by_val_( std::true_type )
+  {
+    if( entries.empty() )
+      return;
+    long long lo = key_( entries[0].val ), hi = lo;
+    for( const entry_t& e: entries ) {
+      long long v = key_( e.val );
+      if( v < lo ) lo = v;
+      if( v > hi ) hi = v;
+    }
+    unsigned long long range = (unsigned long long)hi - (unsigned long long)lo;
+    dense = range < entries.size() * 4 + 64;
+    if( dense ) {
+      val_min = lo;
+      by_val.assign( (size_t)range + 1, 0 );
+      for( size_t i = 0; i < entries.size(); ++i ) {
+        uint32_t& k = by_val[(size_t)((unsigned long long)key_( entries[i].val ) - (unsigned long long)lo)];
+        if( !k ) k = (uint32_t)i + 1;
+      }
+      return;
+    }
+    by_val.assign( by_name.size(), 0 );
+    for( size_t i = 0; i < entries.size(); ++i ) {
+      uint32_t& k = by_val[val_pos_( key_( entries[i].val ) )];
+      if( !k ) k = (uint32_t)i + 1;
+    }
+  }
+  void build_by_val_( std::false_type ) {}
+
+  const entry_t* find_value_( const T& _v, std::true_type ) const
+  {
+    if( entries.empty() )
+      return nullptr;
+    uint32_t k;
+    if( dense ) {
+      unsigned long long d = (unsigned long long)key_( _v ) - (unsigned long long)val_min;
+      k = d < by_val.size() ? by_val[(size_t)d] : 0;
+    }
+    else {
+      k = by_val[val_pos_( key_( _v ) )];
+    }
+    return k ? &entries[k - 1] : nullptr;
+  }
+  const entry_t* find_value_( const T& _v, std::false_type ) const
+  {
+    for( const entry_t& e: entries ) {
+      if( e.val == _v )
+        return &e;
+    }
+    return nullptr;
+  }
 };
 
 template<class T>
 static bool x2s_value_( strview_t _str, T* _out )
 {
-  x2s_by_str<T> s( _str, _out );
-  xio<T>::x2s_map_( s );
-  return s;
+  const typename x2s_table_t<T>::entry_t* e = x2s_table_t<T>::of().find_name( _str );
+  if( !e )
+    return false;
+  *_out = e->val;
+  return true;
 }
 
 template<class T>
@@ -76,9 +204,11 @@ static T x2s_value_( strview_t _str )
 template<class T, class Out>
 static bool x2s_name_( T _val, Out* _out )
 {
-  x2s_by_val<T, Out> s( _val, _out );
-  xio<T>::x2s_map_( s );
-  return s;
+  const typename x2s_table_t<T>::entry_t* e = x2s_table_t<T>::of().find_value( _val );
+  if( !e )
+    return false;
+  _out->assign( e->name.data(), e->name.size() );
+  return true;
 }
 
 template<class T>
@@ -89,63 +219,22 @@ static strview_t x2s_name_( T _val )
 }
 
 
-static inline uint8_t hexch_to_int_( const char ch )
-{
-  if( '0' <= ch && ch <='9' )
-    return (uint8_t)(ch - '0');
-  if( 'A' <= ch && ch <='F' )
-    return (uint8_t)(ch - 'A' + 10);
-  if( 'a' <= ch && ch <='f' )
-    return (uint8_t)(ch - 'a' + 10);
-  throw "Invalid hex char";
-}
-
-static void json_str_to_bin_( void* _out, const char* _data, size_t _size )
-{
-  uint8_t* v = (uint8_t*)_out;
-  const char* p = _data;
-  const char* e = p + _size;
-  for( ; p < e; p += 2 ) {
-    uint8_t b1 = hexch_to_int_( *p );
-    uint8_t b2 = hexch_to_int_( *(p+1) );
-    *v = (char)(b1 << 4 | b2);
-    v++;
-  }
-}
-
-static void json_str_to_bin_( std::string* _out, const char* _data, size_t _size )
-{
-  if( 0 != _size % 2 ) {
-    throw "Invalid hex data length";
-  }
-  size_t n = _out->size();
-  _out->resize( n + _size / 2 );
-  char* v = (char*)_out->data() + n;
-  json_str_to_bin_( v, _data, _size );
-}
-
-template< class S >
-static void json_bin_to_str_( S& _out, const void* _data, size_t _size )
-{
-  _out.reserve( _out.size() + _size * 2 );
-  size_t i = 0;
-  const uint8_t* p = (const uint8_t*)_data;
-  for( ; i < _size; ++i, ++p ) {
-    _out += "0123456789ABCDEF"[((*p) >> 4)];
-    _out += "0123456789ABCDEF"[((*p) & 0x0f)];
-  }
-}
-
-
 struct JsonIn;
 struct JsonInValue;
-struct JsonOut;
-struct JsonOutValue;
+struct json_pretty_t;
+template< class P > struct JsonOutBasic;
+template< class P > struct JsonOutValueBasic;
+typedef JsonOutBasic<json_pretty_t> JsonOut;
+typedef JsonOutValueBasic<json_pretty_t> JsonOutValue;
+
+// Bin field encodings; json_bin_stream takes the output policy's bin, or json_bin_scope_t when reading
+enum { json_bin_stream = -1, json_bin_hex = 0, json_bin_base64 = 1, json_bin_base64url = 2 };
 
 struct JsonInBinS
 {
   std::string& v;
-  JsonInBinS(std::string& _v) : v(_v) {}
+  int enc;
+  JsonInBinS(std::string& _v, int _enc = json_bin_stream) : v(_v), enc(_enc) {}
 };
 
 
@@ -153,18 +242,20 @@ struct JsonInBinX
 {
   void*  v_data;
   size_t v_size;
+  int enc;
   template< class T >
-  JsonInBinX( T& _v ) : v_data(&_v), v_size(sizeof(_v)) {}
+  JsonInBinX( T& _v, int _enc = json_bin_stream ) : v_data(&_v), v_size(sizeof(_v)), enc(_enc) {}
 };
 
 struct JsonOutBinX
 {
   const void* v_data;
   size_t v_size;
-  JsonOutBinX(const std::string& _v) : v_data(_v.data()), v_size(_v.size()) {}
-  JsonOutBinX(const strview_t& _v) : v_data(_v.data()), v_size(_v.size()) {}
+  int enc;
+  JsonOutBinX(const std::string& _v, int _enc = json_bin_stream) : v_data(_v.data()), v_size(_v.size()), enc(_enc) {}
+  JsonOutBinX(const strview_t& _v, int _enc = json_bin_stream) : v_data(_v.data()), v_size(_v.size()), enc(_enc) {}
   template< class T >
-  JsonOutBinX(const T& _v) : v_data(&_v), v_size(sizeof(_v)) {}
+  JsonOutBinX(const T& _v, int _enc = json_bin_stream) : v_data(&_v), v_size(sizeof(_v)), enc(_enc) {}
   const void* data() const { return v_data; }
        size_t size() const { return v_size; }
 };
@@ -186,10 +277,597 @@ static inline bool is_json_ws_( const char c ) { return ' ' == c || '\t' == c ||
 static inline bool is_json_qs_( const char c ) { return '"' == c || '\'' == c; }
 static inline bool is_json_val_end_( const char c ) { return is_json_ws_(c) || ',' == c || '}' == c || ']' == c; }
 
+/////////////////////////////////////////////////////////// scanners /////////////////////////////////////////////////////////////
+
+// Structural scanners look at 64 bytes per step: a kernel K returns one bit per byte equal to a char
+// (eq64), not above a char (le64) or with the high bit set (hi64).
+// SSE2 is used when the target has it, AVX2 is picked at runtime on gcc/clang, SWAR everywhere else.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSONIO_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define JSONIO_AVX2 1
+#include <immintrin.h>
+#elif defined(JSONIO_SSE2) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define JSONIO_AVX2_DISPATCH 1
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+static inline unsigned json_ctz64_( uint64_t m )
+{
+  ASSERT( m );
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long i; _BitScanForward64( &i, m ); return (unsigned)i;
+#else
+  return (unsigned)__builtin_ctzll( m );
+#endif
+}
+static inline unsigned json_clz64_( uint64_t m )
+{
+  ASSERT( m );
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long i; _BitScanReverse64( &i, m ); return 63 - (unsigned)i;
+#else
+  return (unsigned)__builtin_clzll( m );
+#endif
+}
+static inline unsigned json_popcount64_( uint64_t m )
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+  m = m - ((m >> 1) & 0x5555555555555555ULL);
+  m = (m & 0x3333333333333333ULL) + ((m >> 2) & 0x3333333333333333ULL);
+  return (unsigned)((((m + (m >> 4)) & 0x0f0f0f0f0f0f0f0fULL) * 0x0101010101010101ULL) >> 56);
+#else
+  return (unsigned)__builtin_popcountll( m );
+#endif
+}
+
+struct json_simd_swar_
+{
+  static inline uint64_t load8( const char* p )
+  {
+    uint64_t w;
+    memcpy( &w, p, 8 );
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64( w );
+#endif
+    return w;
+  }
+  // 0x80 flags of 8 bytes -> 8 bits
+  static inline uint64_t bits8( uint64_t z ) { return ((z >> 7) * 0x0102040810204080ULL) >> 56; }
+
+  static inline uint64_t eq64( const char* p, const char c )
+  {
+    const uint64_t lo7 = 0x7f7f7f7f7f7f7f7fULL;
+    const uint64_t cc = 0x0101010101010101ULL * (uint8_t)c;
+    uint64_t m = 0;
+    for( unsigned i = 0; i < 64; i += 8 ) {
+      uint64_t w = load8( p + i ) ^ cc;
+      uint64_t z = ~(((w & lo7) + lo7) | w | lo7); // 0x80 in every zero byte
+      m |= bits8( z ) << i;
+    }
+    return m;
+  }
+  // bytes <= c, c < 0x80
+  static inline uint64_t le64( const char* p, const char c )
+  {
+    const uint64_t lo7 = 0x7f7f7f7f7f7f7f7fULL;
+    const uint64_t cc = 0x0101010101010101ULL * (uint8_t)(0x7f - c);
+    uint64_t m = 0;
+    for( unsigned i = 0; i < 64; i += 8 ) {
+      uint64_t w = load8( p + i );
+      uint64_t z = ~(((w & lo7) + cc) | w) & ~lo7;
+      m |= bits8( z ) << i;
+    }
+    return m;
+  }
+  // bytes >= 0x80
+  static inline uint64_t hi64( const char* p )
+  {
+    uint64_t m = 0;
+    for( unsigned i = 0; i < 64; i += 8 )
+      m |= bits8( load8( p + i ) & ~0x7f7f7f7f7f7f7f7fULL ) << i;
+    return m;
+  }
+  // hex blocks: none, the table loop does it all
+  static inline size_t hex_encode( const uint8_t* p, size_t n, char* o ) { return 0; }
+  static inline size_t hex_decode( const char* s, size_t n, uint8_t* o, unsigned* _bad ) { return 0; }
+  static inline size_t b64_encode( const uint8_t* p, size_t i, size_t n, char* o, bool _url ) { return i; }
+  static inline size_t b64_decode( const char* s, size_t i, size_t n, uint8_t* o, unsigned* _bad ) { return i; }
+};
+
+#ifdef JSONIO_SSE2
+struct json_simd_sse2_
+{
+  static inline uint64_t eq64( const char* p, const char c )
+  {
+    const __m128i cc = _mm_set1_epi8( c );
+    uint64_t m = 0;
+    for( unsigned i = 0; i < 4; ++i ) {
+      __m128i v = _mm_loadu_si128( (const __m128i*)(p + 16 * i) );
+      m |= (uint64_t)(unsigned)_mm_movemask_epi8( _mm_cmpeq_epi8( v, cc ) ) << (16 * i);
+    }
+    return m;
+  }
+  static inline uint64_t le64( const char* p, const char c )
+  {
+    const __m128i cc = _mm_set1_epi8( c );
+    uint64_t m = 0;
+    for( unsigned i = 0; i < 4; ++i ) {
+      __m128i v = _mm_loadu_si128( (const __m128i*)(p + 16 * i) );
+      m |= (uint64_t)(unsigned)_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_max_epu8( v, cc ), cc ) ) << (16 * i);
+    }
+    return m;
+  }
+  static inline uint64_t hi64( const char* p )
+  {
+    uint64_t m = 0;
+    for( unsigned i = 0; i < 4; ++i )
+      m |= (uint64_t)(unsigned)_mm_movemask_epi8( _mm_loadu_si128( (const __m128i*)(p + 16 * i) ) ) << (16 * i);
+    return m;
+  }
+
+  // nibbles -> '0'..'9', 'A'..'F'
+  static inline __m128i hex_digits( __m128i n )
+  {
+    __m128i letter = _mm_and_si128( _mm_cmpgt_epi8( n, _mm_set1_epi8( 9 ) ), _mm_set1_epi8( 'A' - '0' - 10 ) );
+    return _mm_add_epi8( _mm_add_epi8( n, _mm_set1_epi8( '0' ) ), letter );
+  }
+  // hex chars -> nibbles, *_bad gets a bit per non-hex char
+  static inline __m128i hex_values( __m128i c, unsigned* _bad )
+  {
+    __m128i d = _mm_sub_epi8( c, _mm_set1_epi8( '0' ) );
+    __m128i l = _mm_sub_epi8( _mm_or_si128( c, _mm_set1_epi8( 0x20 ) ), _mm_set1_epi8( 'a' ) );
+    __m128i is_d = _mm_cmpeq_epi8( _mm_min_epu8( d, _mm_set1_epi8( 9 ) ), d );
+    __m128i is_l = _mm_cmpeq_epi8( _mm_min_epu8( l, _mm_set1_epi8( 5 ) ), l );
+    *_bad |= 0xffff ^ (unsigned)_mm_movemask_epi8( _mm_or_si128( is_d, is_l ) );
+    return _mm_or_si128( _mm_and_si128( is_d, d ), _mm_and_si128( is_l, _mm_add_epi8( l, _mm_set1_epi8( 10 ) ) ) );
+  }
+  // 16 bytes -> 32 chars per step, returns bytes done
+  static inline size_t hex_encode( const uint8_t* p, size_t n, char* o )
+  {
+    const __m128i m4 = _mm_set1_epi8( 0x0f );
+    size_t i = 0;
+    for( ; i + 16 <= n; i += 16, o += 32 ) {
+      __m128i v = _mm_loadu_si128( (const __m128i*)(p + i) );
+      __m128i hi = hex_digits( _mm_and_si128( _mm_srli_epi16( v, 4 ), m4 ) );
+      __m128i lo = hex_digits( _mm_and_si128( v, m4 ) );
+      _mm_storeu_si128( (__m128i*)o, _mm_unpacklo_epi8( hi, lo ) );
+      _mm_storeu_si128( (__m128i*)(o + 16), _mm_unpackhi_epi8( hi, lo ) );
+    }
+    return i;
+  }
+  // 32 chars -> 16 bytes per step, returns chars done
+  static inline size_t hex_decode( const char* s, size_t n, uint8_t* o, unsigned* _bad )
+  {
+    const __m128i lo8 = _mm_set1_epi16( 0x00ff );
+    size_t i = 0;
+    for( ; i + 32 <= n; i += 32, o += 16 ) {
+      __m128i a = hex_values( _mm_loadu_si128( (const __m128i*)(s + i) ), _bad );
+      __m128i b = hex_values( _mm_loadu_si128( (const __m128i*)(s + i + 16) ), _bad );
+      // 16 bit lanes hold (high nibble, low nibble)
+      a = _mm_or_si128( _mm_slli_epi16( _mm_and_si128( a, lo8 ), 4 ), _mm_srli_epi16( a, 8 ) );
+      b = _mm_or_si128( _mm_slli_epi16( _mm_and_si128( b, lo8 ), 4 ), _mm_srli_epi16( b, 8 ) );
+      _mm_storeu_si128( (__m128i*)o, _mm_packus_epi16( a, b ) );
+    }
+    return i;
+  }
+  // base64 needs a byte shuffle, left to the tables below AVX2
+  static inline size_t b64_encode( const uint8_t* p, size_t i, size_t n, char* o, bool _url ) { return i; }
+  static inline size_t b64_decode( const char* s, size_t i, size_t n, uint8_t* o, unsigned* _bad ) { return i; }
+};
+#endif
+
+#if defined(JSONIO_AVX2) || defined(JSONIO_AVX2_DISPATCH)
+#ifdef JSONIO_AVX2_DISPATCH
+#define JSONIO_AVX2_FN __attribute__((target("avx2")))
+#else
+#define JSONIO_AVX2_FN
+#endif
+struct json_simd_avx2_
+{
+  JSONIO_AVX2_FN static inline uint64_t eq64( const char* p, const char c )
+  {
+    const __m256i cc = _mm256_set1_epi8( c );
+    uint64_t lo = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_loadu_si256( (const __m256i*)p ), cc ) );
+    uint64_t hi = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_loadu_si256( (const __m256i*)(p + 32) ), cc ) );
+    return lo | (hi << 32);
+  }
+  JSONIO_AVX2_FN static inline uint64_t le64( const char* p, const char c )
+  {
+    const __m256i cc = _mm256_set1_epi8( c );
+    __m256i v0 = _mm256_loadu_si256( (const __m256i*)p );
+    __m256i v1 = _mm256_loadu_si256( (const __m256i*)(p + 32) );
+    uint64_t lo = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_max_epu8( v0, cc ), cc ) );
+    uint64_t hi = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_max_epu8( v1, cc ), cc ) );
+    return lo | (hi << 32);
+  }
+  JSONIO_AVX2_FN static inline uint64_t hi64( const char* p )
+  {
+    uint64_t lo = (uint32_t)_mm256_movemask_epi8( _mm256_loadu_si256( (const __m256i*)p ) );
+    uint64_t hi = (uint32_t)_mm256_movemask_epi8( _mm256_loadu_si256( (const __m256i*)(p + 32) ) );
+    return lo | (hi << 32);
+  }
+
+  JSONIO_AVX2_FN static inline __m256i hex_digits( __m256i n )
+  {
+    __m256i letter = _mm256_and_si256( _mm256_cmpgt_epi8( n, _mm256_set1_epi8( 9 ) ), _mm256_set1_epi8( 'A' - '0' - 10 ) );
+    return _mm256_add_epi8( _mm256_add_epi8( n, _mm256_set1_epi8( '0' ) ), letter );
+  }
+  JSONIO_AVX2_FN static inline __m256i hex_values( __m256i c, unsigned* _bad )
+  {
+    __m256i d = _mm256_sub_epi8( c, _mm256_set1_epi8( '0' ) );
+    __m256i l = _mm256_sub_epi8( _mm256_or_si256( c, _mm256_set1_epi8( 0x20 ) ), _mm256_set1_epi8( 'a' ) );
+    __m256i is_d = _mm256_cmpeq_epi8( _mm256_min_epu8( d, _mm256_set1_epi8( 9 ) ), d );
+    __m256i is_l = _mm256_cmpeq_epi8( _mm256_min_epu8( l, _mm256_set1_epi8( 5 ) ), l );
+    *_bad |= ~(unsigned)_mm256_movemask_epi8( _mm256_or_si256( is_d, is_l ) );
+    return _mm256_or_si256( _mm256_and_si256( is_d, d ), _mm256_and_si256( is_l, _mm256_add_epi8( l, _mm256_set1_epi8( 10 ) ) ) );
+  }
+  // 32 bytes -> 64 chars per step; unpack works per 128 bit lane, the permute puts the lanes in order
+  JSONIO_AVX2_FN static inline size_t hex_encode( const uint8_t* p, size_t n, char* o )
+  {
+    const __m256i m4 = _mm256_set1_epi8( 0x0f );
+    size_t i = 0;
+    for( ; i + 32 <= n; i += 32, o += 64 ) {
+      __m256i v = _mm256_loadu_si256( (const __m256i*)(p + i) );
+      __m256i hi = hex_digits( _mm256_and_si256( _mm256_srli_epi16( v, 4 ), m4 ) );
+      __m256i lo = hex_digits( _mm256_and_si256( v, m4 ) );
+      __m256i a = _mm256_unpacklo_epi8( hi, lo );
+      __m256i b = _mm256_unpackhi_epi8( hi, lo );
+      _mm256_storeu_si256( (__m256i*)o, _mm256_permute2x128_si256( a, b, 0x20 ) );
+      _mm256_storeu_si256( (__m256i*)(o + 32), _mm256_permute2x128_si256( a, b, 0x31 ) );
+    }
+    return i;
+  }
+  // 64 chars -> 32 bytes per step
+  JSONIO_AVX2_FN static inline size_t hex_decode( const char* s, size_t n, uint8_t* o, unsigned* _bad )
+  {
+    const __m256i lo8 = _mm256_set1_epi16( 0x00ff );
+    size_t i = 0;
+    for( ; i + 64 <= n; i += 64, o += 32 ) {
+      __m256i a = hex_values( _mm256_loadu_si256( (const __m256i*)(s + i) ), _bad );
+      __m256i b = hex_values( _mm256_loadu_si256( (const __m256i*)(s + i + 32) ), _bad );
+      a = _mm256_or_si256( _mm256_slli_epi16( _mm256_and_si256( a, lo8 ), 4 ), _mm256_srli_epi16( a, 8 ) );
+      b = _mm256_or_si256( _mm256_slli_epi16( _mm256_and_si256( b, lo8 ), 4 ), _mm256_srli_epi16( b, 8 ) );
+      _mm256_storeu_si256( (__m256i*)o, _mm256_permute4x64_epi64( _mm256_packus_epi16( a, b ), 0xd8 ) );
+    }
+    return i;
+  }
+
+  // base64, W. Mula and D. Lemire: 24 bytes -> 32 chars per step. Reads 4 bytes before p + i, so i >= 4.
+  JSONIO_AVX2_FN static inline size_t b64_encode( const uint8_t* p, size_t i, size_t n, char* o, bool _url )
+  {
+    const __m256i shuf = _mm256_set_epi8( 10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                          14, 15, 13, 14, 11, 12, 10, 11, 8, 9, 7, 8, 5, 6, 4, 5 );
+    // offsets from 6 bit values to chars for A-Z, a-z, 0-9 (x10), 62, 63
+    const __m256i lut = _url
+      ? _mm256_setr_epi8( 65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -17, 32, 0, 0, 65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -17, 32, 0, 0 )
+      : _mm256_setr_epi8( 65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0, 65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0 );
+    for( ; i + 28 <= n; i += 24, o += 32 ) {
+      __m256i v = _mm256_shuffle_epi8( _mm256_loadu_si256( (const __m256i*)(p + i - 4) ), shuf );
+      __m256i t0 = _mm256_mulhi_epu16( _mm256_and_si256( v, _mm256_set1_epi32( 0x0fc0fc00 ) ), _mm256_set1_epi32( 0x04000040 ) );
+      __m256i t1 = _mm256_mullo_epi16( _mm256_and_si256( v, _mm256_set1_epi32( 0x003f03f0 ) ), _mm256_set1_epi32( 0x01000010 ) );
+      v = _mm256_or_si256( t0, t1 ); // a 6 bit value per byte
+      __m256i idx = _mm256_sub_epi8( _mm256_subs_epu8( v, _mm256_set1_epi8( 51 ) ), _mm256_cmpgt_epi8( v, _mm256_set1_epi8( 25 ) ) );
+      _mm256_storeu_si256( (__m256i*)o, _mm256_add_epi8( v, _mm256_shuffle_epi8( lut, idx ) ) );
+    }
+    return i;
+  }
+  // 32 chars -> 24 bytes per step, both alphabets. Stores 32 bytes, so at least 8 more output bytes must follow.
+  JSONIO_AVX2_FN static inline size_t b64_decode( const char* s, size_t i, size_t n, uint8_t* o, unsigned* _bad )
+  {
+    const __m256i lut_lo = _mm256_setr_epi8( 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+                                             0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a );
+    const __m256i lut_hi = _mm256_setr_epi8( 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                             0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 );
+    const __m256i lut_roll = _mm256_setr_epi8( 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                               0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 );
+    const __m256i m2f = _mm256_set1_epi8( 0x2f );
+    const __m256i pack = _mm256_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                           2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 );
+    for( ; i + 32 + 16 <= n; i += 32, o += 24 ) {
+      __m256i c = _mm256_loadu_si256( (const __m256i*)(s + i) );
+      // url-safe '-' and '_' -> '+' and '/'
+      c = _mm256_blendv_epi8( c, _mm256_set1_epi8( '+' ), _mm256_cmpeq_epi8( c, _mm256_set1_epi8( '-' ) ) );
+      c = _mm256_blendv_epi8( c, m2f, _mm256_cmpeq_epi8( c, _mm256_set1_epi8( '_' ) ) );
+      __m256i hi_n = _mm256_and_si256( _mm256_srli_epi32( c, 4 ), m2f );
+      __m256i lo_n = _mm256_and_si256( c, m2f );
+      if( !_mm256_testz_si256( _mm256_shuffle_epi8( lut_lo, lo_n ), _mm256_shuffle_epi8( lut_hi, hi_n ) ) ) {
+        *_bad |= 1;
+        return i;
+      }
+      __m256i roll = _mm256_shuffle_epi8( lut_roll, _mm256_add_epi8( _mm256_cmpeq_epi8( c, m2f ), hi_n ) );
+      c = _mm256_add_epi8( c, roll ); // 6 bit values
+      c = _mm256_maddubs_epi16( c, _mm256_set1_epi32( 0x01400140 ) );
+      c = _mm256_madd_epi16( c, _mm256_set1_epi32( 0x00011000 ) );
+      c = _mm256_shuffle_epi8( c, pack );
+      c = _mm256_permutevar8x32_epi32( c, _mm256_setr_epi32( 0, 1, 2, 4, 5, 6, -1, -1 ) );
+      _mm256_storeu_si256( (__m256i*)o, c );
+    }
+    return i;
+  }
+};
+#endif
+
+#if defined(JSONIO_AVX2)
+typedef json_simd_avx2_ json_simd_t;
+#elif defined(JSONIO_SSE2)
+typedef json_simd_sse2_ json_simd_t;
+#else
+typedef json_simd_swar_ json_simd_t;
+#endif
+
+#ifdef JSONIO_AVX2_DISPATCH
+static inline bool json_has_avx2_()
+{
+  static const bool r = __builtin_cpu_supports( "avx2" );
+  return r;
+}
+// flatten: inline the generic loop and the avx2 kernel into one avx2 function
+#define JSONIO_SIMD_DISPATCH( name, args, call ) \
+  __attribute__((target("avx2"), flatten)) static size_t name##avx2_ args { return name##k_<json_simd_avx2_> call; } \
+  static inline size_t name args { return json_has_avx2_() ? name##avx2_ call : name##k_<json_simd_t> call; }
+#else
+#define JSONIO_SIMD_DISPATCH( name, args, call ) \
+  static inline size_t name args { return name##k_<json_simd_t> call; }
+#endif
+
+// bytes escaped by a preceding odd run of backslashes; _carry tells whether the next block starts escaped
+static inline uint64_t json_escaped_mask_( uint64_t bs, uint64_t& _carry )
+{
+  const uint64_t even_bits = 0x5555555555555555ULL;
+  bs &= ~_carry;
+  uint64_t follows_escape = (bs << 1) | _carry;
+  uint64_t odd_starts = bs & ~even_bits & ~follows_escape;
+  uint64_t seq_on_even = odd_starts + bs;
+  _carry = seq_on_even < odd_starts; // overflow
+  uint64_t invert = seq_on_even << 1;
+  return (even_bits ^ invert) & follows_escape;
+}
+
+// first unescaped q at or after i, n if none
+template< class K >
+static inline size_t json_find_quote_k_( const char* s, size_t i, size_t n, const char q )
+{
+  uint64_t carry = 0;
+  for( ; i + 64 <= n; i += 64 ) {
+    uint64_t bs = K::eq64( s + i, '\\' );
+    uint64_t qm = K::eq64( s + i, q ) & ~json_escaped_mask_( bs, carry );
+    if( qm )
+      return i + json_ctz64_( qm );
+  }
+  for( i += (size_t)carry; i < n; ++i ) {
+    if( '\\' == s[i] ) {
+      ++i;
+      continue;
+    }
+    if( q == s[i] )
+      return i;
+  }
+  return n;
+}
+JSONIO_SIMD_DISPATCH( json_find_quote_, ( const char* s, size_t i, size_t n, const char q ), ( s, i, n, q ) )
+
+// first c at or after i, n if none
+template< class K >
+static inline size_t json_find_char_k_( const char* s, size_t i, size_t n, const char c )
+{
+  for( ; i + 64 <= n; i += 64 ) {
+    uint64_t m = K::eq64( s + i, c );
+    if( m )
+      return i + json_ctz64_( m );
+  }
+  for( ; i < n && c != s[i]; ++i ) {}
+  return i;
+}
+JSONIO_SIMD_DISPATCH( json_find_char_, ( const char* s, size_t i, size_t n, const char c ), ( s, i, n, c ) )
+
+// number of c in [i, n)
+template< class K >
+static inline size_t json_count_char_k_( const char* s, size_t i, size_t n, const char c )
+{
+  size_t r = 0;
+  for( ; i + 64 <= n; i += 64 )
+    r += json_popcount64_( K::eq64( s + i, c ) );
+  for( ; i < n; ++i )
+    r += (c == s[i]);
+  return r;
+}
+JSONIO_SIMD_DISPATCH( json_count_char_, ( const char* s, size_t i, size_t n, const char c ), ( s, i, n, c ) )
+
+// first of c1, c2 or a quote at or after i, n if none
+template< class K >
+static inline size_t json_find_struct_k_( const char* s, size_t i, size_t n, const char c1, const char c2 )
+{
+  for( ; i + 64 <= n; i += 64 ) {
+    uint64_t m = K::eq64( s + i, c1 ) | K::eq64( s + i, c2 ) | K::eq64( s + i, '"' ) | K::eq64( s + i, '\'' );
+    if( m )
+      return i + json_ctz64_( m );
+  }
+  for( ; i < n && c1 != s[i] && c2 != s[i] && !is_json_qs_(s[i]); ++i ) {}
+  return i;
+}
+JSONIO_SIMD_DISPATCH( json_find_struct_, ( const char* s, size_t i, size_t n, const char c1, const char c2 ), ( s, i, n, c1, c2 ) )
+
+// first comma, bracket, brace or quote at or after i, n if none
+template< class K >
+static inline size_t json_find_item_k_( const char* s, size_t i, size_t n )
+{
+  for( ; i + 64 <= n; i += 64 ) {
+    uint64_t m = K::eq64( s + i, ',' ) | K::eq64( s + i, '[' ) | K::eq64( s + i, ']' ) | K::eq64( s + i, '{' ) | K::eq64( s + i, '}' )
+               | K::eq64( s + i, '"' ) | K::eq64( s + i, '\'' );
+    if( m )
+      return i + json_ctz64_( m );
+  }
+  for( ; i < n && ',' != s[i] && '[' != s[i] && ']' != s[i] && '{' != s[i] && '}' != s[i] && !is_json_qs_(s[i]); ++i ) {}
+  return i;
+}
+JSONIO_SIMD_DISPATCH( json_find_item_, ( const char* s, size_t i, size_t n ), ( s, i, n ) )
+
+template< class K >
+static inline uint64_t json_ws64_k_( const char* p )
+{
+  return K::eq64( p, ' ' ) | K::eq64( p, '\t' ) | K::eq64( p, '\n' ) | K::eq64( p, '\r' );
+}
+// first non-whitespace at or after i, n if none
+template< class K >
+static inline size_t json_find_non_ws_k_( const char* s, size_t i, size_t n )
+{
+  for( ; i + 64 <= n; i += 64 ) {
+    uint64_t m = ~json_ws64_k_<K>( s + i );
+    if( m )
+      return i + json_ctz64_( m );
+  }
+  for( ; i < n && is_json_ws_(s[i]); ++i ) {}
+  return i;
+}
+JSONIO_SIMD_DISPATCH( json_find_non_ws_, ( const char* s, size_t i, size_t n ), ( s, i, n ) )
+
+// length of s[0, n) without trailing whitespace
+template< class K >
+static inline size_t json_rfind_non_ws_k_( const char* s, size_t n )
+{
+  for( ; n >= 64; n -= 64 ) {
+    uint64_t m = ~json_ws64_k_<K>( s + n - 64 );
+    if( m )
+      return n - json_clz64_( m );
+  }
+  for( ; n > 0 && is_json_ws_(s[n - 1]); --n ) {}
+  return n;
+}
+JSONIO_SIMD_DISPATCH( json_rfind_non_ws_, ( const char* s, size_t n ), ( s, n ) )
+
+// Escape class of a byte in a JSON string: 0 - copied as is, 'u' - \u00XX, else the char after the backslash
+static const char json_escape_class_[256] = {
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+  0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+// String escape modes, picked by the output policy:
+// default - escape quote, backslash and all control chars, copy other bytes;
+// strict - also check UTF-8 and write invalid bytes as \ufffd, so output is always valid RFC 8259;
+// ascii - strict, and non-ASCII chars as \uXXXX (surrogate pairs above U+FFFF).
+enum { json_escape_default = 0, json_escape_strict = 1, json_escape_ascii = 2 };
+
+// first byte at or after i that needs escaping, n if none; _hi also stops at bytes >= 0x80
+template< class K >
+static inline size_t json_find_escape_k_( const char* s, size_t i, size_t n, bool _hi )
+{
+  for( ; i + 64 <= n; i += 64 ) {
+    uint64_t m = K::le64( s + i, 0x1f ) | K::eq64( s + i, '"' ) | K::eq64( s + i, '\\' );
+    if( _hi )
+      m |= K::hi64( s + i );
+    if( m )
+      return i + json_ctz64_( m );
+  }
+  for( ; i < n && !json_escape_class_[(uint8_t)s[i]] && !(_hi && (s[i] & 0x80)); ++i ) {}
+  return i;
+}
+JSONIO_SIMD_DISPATCH( json_find_escape_, ( const char* s, size_t i, size_t n, bool _hi ), ( s, i, n, _hi ) )
+
+// One UTF-8 char at p: returns its length and code point, 0 if the sequence is invalid
+// (truncated, overlong, surrogate or above U+10FFFF)
+static inline unsigned json_utf8_decode_( const uint8_t* p, const uint8_t* e, uint32_t* _cp )
+{
+  uint32_t c = p[0];
+  if( c < 0x80 ) {
+    *_cp = c;
+    return 1;
+  }
+  unsigned n;
+  uint32_t min;
+  if( (c & 0xe0) == 0xc0 ) { n = 2; c &= 0x1f; min = 0x80; }
+  else if( (c & 0xf0) == 0xe0 ) { n = 3; c &= 0x0f; min = 0x800; }
+  else if( (c & 0xf8) == 0xf0 ) { n = 4; c &= 0x07; min = 0x10000; }
+  else return 0;
+  if( (size_t)(e - p) < n )
+    return 0;
+  for( unsigned i = 1; i < n; ++i ) {
+    if( (p[i] & 0xc0) != 0x80 )
+      return 0;
+    c = (c << 6) | (p[i] & 0x3f);
+  }
+  if( c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff) )
+    return 0;
+  *_cp = c;
+  return n;
+}
+
+static inline char* json_utf8_encode_( char* o, uint32_t c )
+{
+  if( c < 0x80 ) {
+    *o++ = (char)c;
+  }
+  else if( c < 0x800 ) {
+    *o++ = (char)(0xc0 | (c >> 6));
+    *o++ = (char)(0x80 | (c & 0x3f));
+  }
+  else if( c < 0x10000 ) {
+    *o++ = (char)(0xe0 | (c >> 12));
+    *o++ = (char)(0x80 | ((c >> 6) & 0x3f));
+    *o++ = (char)(0x80 | (c & 0x3f));
+  }
+  else {
+    *o++ = (char)(0xf0 | (c >> 18));
+    *o++ = (char)(0x80 | ((c >> 12) & 0x3f));
+    *o++ = (char)(0x80 | ((c >> 6) & 0x3f));
+    *o++ = (char)(0x80 | (c & 0x3f));
+  }
+  return o;
+}
+
+// Throws on raw control chars or invalid UTF-8 in s[0, n); ASCII blocks are skipped 64 bytes at a time
+static inline void json_check_utf8_( const char* s, size_t n )
+{
+  for( size_t i = json_find_escape_( s, 0, n, true ); i < n; i = json_find_escape_( s, i, n, true ) ) {
+    const uint8_t b = (uint8_t)s[i];
+    if( b < 0x20 )
+      throw std::string("control char in string");
+    if( b < 0x80 ) { // quote or backslash
+      ++i;
+      continue;
+    }
+    uint32_t cp;
+    unsigned k = json_utf8_decode_( (const uint8_t*)s + i, (const uint8_t*)s + n, &cp );
+    if( !k )
+      throw std::string("invalid UTF-8 in string");
+    i += k;
+  }
+}
+
+static inline const char* json_skip_ws_( const char* p, const char* e )
+{
+  if( p < e && !is_json_ws_(*p) ) // usual case, avoid the call
+    return p;
+  return p + json_find_non_ws_( p, 0, e - p );
+}
+
 static inline void json_trim_ws_( strview_t& x )
 {
-  for( ; !x.empty() && is_json_ws_(x.front()); x.pop_front() ) {}
-  for( ; !x.empty() && is_json_ws_(x.back()); x.pop_back() ) {}
+  if( x.empty() )
+    return;
+  if( is_json_ws_(x.front()) )
+    x.remove_prefix( json_find_non_ws_( x.data(), 0, x.size() ) );
+  if( !x.empty() && is_json_ws_(x.back()) )
+    x.remove_suffix( x.size() - json_rfind_non_ws_( x.data(), x.size() ) );
 }
 
 static inline bool json_trim_ch_( strview_t& x, const char c1, const char c2 )
@@ -207,35 +885,12 @@ static inline bool json_trim_ch_( strview_t& x, const char c1, const char c2 )
   return true;
 }
 
-static inline bool is_json_begin_( strview_t x )
-{
-  if( x.empty() )
-    return true;
-  const char* rI = x.end() - 1;
-  const char* rE = x.begin() - 1;
-  for( ; rI != rE && is_json_ws_(*rI); --rI) {}
-  if( rI == rE )
-    return true;
-  if( '{' == *rI || '[' == *rI )
-    return true;
-  return false;
-}
-
 static inline size_t json_find_closing_quote_( const strview_t& x, size_t i, const char q )
 {
   ASSERT( i > 0 );
-  size_t n = x.size();
-  for( ; i < n; ++i )
-  {
-    if( '\\' == x[i] ) {
-      ++i;
-      continue;
-    }
-    if( q == x[i] )
-    {
-      return i;
-    }
-  }
+  i = json_find_quote_( x.data(), i, x.size(), q );
+  if( i < x.size() )
+    return i;
   throw std::string("expected closing quote ") + q;
   //return n;
 }
@@ -283,7 +938,7 @@ static inline bool json_skip_( strview_t& x, strview_t* v, const char c1, const
     return false;
   size_t nest = 0;
   size_t i = 1, n = x.size();
-  for( ; i < n;  ++i )
+  for( ; (i = json_find_struct_( x.data(), i, n, c1, c2 )) < n; ++i )
   {
     char ch = x[i];
     if( c2 == ch )
@@ -308,6 +963,31 @@ static inline bool json_skip_( strview_t& x, strview_t* v, const char c1, const
   //return false;
 }
 
+// items in an array body without the brackets: top level commas + 1, in one scan
+static inline size_t json_count_items_( const strview_t& x )
+{
+  if( x.empty() )
+    return 0;
+  size_t items = 1, nest = 0;
+  for( size_t i = 0, n = x.size(); (i = json_find_item_( x.data(), i, n )) < n; ++i )
+  {
+    char ch = x[i];
+    if( ',' == ch ) {
+      if( !nest ) items++;
+    }
+    else if( '[' == ch || '{' == ch ) {
+      nest++;
+    }
+    else if( ']' == ch || '}' == ch ) {
+      if( nest ) nest--;
+    }
+    else {
+      i = json_find_closing_quote_( x, i + 1, ch );
+    }
+  }
+  return items;
+}
+
 static inline strview_t json_pop_value_( strview_t& x )
 {
   json_trim_ws_(x);
@@ -347,118 +1027,451 @@ static inline void json_pop_param_value_( strview_t& x, strview_t* _p, strview_t
   *_v = json_pop_value_( x );
 }
 
+static inline bool json_next_param_( strview_t& s, strview_t* _p, strview_t* _v )
+{
+  if( s.empty() )
+    return false;
+  json_pop_param_value_( s, _p, _v );
+  json_trim_ws_( s );
+  if( ',' == s[0] ) {
+    s.pop_front();
+    json_trim_ws_( s );
+  }
+  return true;
+}
+
 template< class T >
 static inline strview_t json_enum_params_( strview_t& s, T _func )
 {
   strview_t p, v;
-  for( ; !s.empty(); )
+  while( json_next_param_( s, &p, &v ) )
   {
-    json_pop_param_value_( s, &p, &v );
-    json_trim_ws_( s );
-    if( ',' == s[0] ) {
-      s.pop_front();
-      json_trim_ws_( s );
-    }
     if( _func( p, v ) )
       return v;
   }
   return strview_t();
 }
 
-/////////////////////////////////////////////////////////// JsonIn /////////////////////////////////////////////////////////////
-
-// used to workaround incomplete type in gcc/clang
-template< class I, class T > struct use_incomplete { typedef I type; };
+/////////////////////////////////////////////////////////// hex /////////////////////////////////////////////////////////////
+// Bin fields: bytes as upper case hex. Whole blocks go through the SIMD kernel, the rest through tables,
+// straight into output sized up front; bad chars are collected and checked once at the end.
+static const uint8_t json_hex_value_[256] = { // 16 - not a hex char
+  16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+  16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+  16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+   0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 16, 16, 16, 16, 16, 16,
+  16, 10, 11, 12, 13, 14, 15, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+  16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+  16, 10, 11, 12, 13, 14, 15, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+  16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+  16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+  16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+  16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+  16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+  16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+  16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+  16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+  16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+};
 
-template< class T >
-static inline bool json_read_( const strview_t& x, T& _v, decltype( &T::template serialize<JsonIn,T> ) _dummy )
+template< class K >
+static inline size_t json_hex_encode_k_( const uint8_t* p, size_t n, char* o )
 {
-  typename use_incomplete<JsonIn, T>::type  ji(x);
-  T::serialize( ji, _v );
-  return true;
+  static const char digits[] = "0123456789ABCDEF";
+  size_t i = K::hex_encode( p, n, o );
+  for( o += 2 * i; i < n; ++i ) {
+    *o++ = digits[p[i] >> 4];
+    *o++ = digits[p[i] & 0x0f];
+  }
+  return n;
 }
-template< class T >
-static inline bool json_read_( const strview_t& x, T& _v, decltype( &xio<T>::template serialize<JsonIn,T> ) _dummy )
-{
-  typename use_incomplete<JsonIn, T>::type  ji(x);
-  xio<T>::serialize( ji, _v );
-  return true;
+JSONIO_SIMD_DISPATCH( json_hex_encode_, ( const uint8_t* p, size_t n, char* o ), ( p, n, o ) )
+
+// n is even; returns 0 if every char was a hex digit
+template< class K >
+static inline size_t json_hex_decode_k_( const char* s, size_t n, uint8_t* o )
+{
+  unsigned bad = 0;
+  size_t i = K::hex_decode( s, n, o, &bad );
+  uint8_t acc = 0;
+  for( o += i / 2; i < n; i += 2 ) {
+    uint8_t h = json_hex_value_[(uint8_t)s[i]];
+    uint8_t l = json_hex_value_[(uint8_t)s[i + 1]];
+    acc |= h | l;
+    *o++ = (uint8_t)(h << 4 | l);
+  }
+  return bad | (acc & 0x10);
 }
-template< class T >
-static inline bool json_read_( const strview_t& x, T& _v, decltype( &xio<T>::template x2s_map_<x2s_dummy> ) _dummy )
+JSONIO_SIMD_DISPATCH( json_hex_decode_, ( const char* s, size_t n, uint8_t* o ), ( s, n, o ) )
+
+static inline void json_str_to_bin_( void* _out, const char* _data, size_t _size )
 {
-  strview_t xx = json_trim_quotes_(x);
-  return x2s_value_( xx, &_v );
+  if( 0 != _size % 2 ) {
+    throw "Invalid hex data length";
+  }
+  if( json_hex_decode_( _data, _size, (uint8_t*)_out ) ) {
+    throw "Invalid hex char";
+  }
 }
-template< class T >
-static inline bool json_read_( const strview_t& x, T& _v, ... )
+
+static inline void json_str_to_bin_( std::string* _out, const char* _data, size_t _size )
 {
-  strview_t xx = json_trim_quotes_(x);
-  return xio<T>::Read( xx, _v );
-}
-template< class X, class T >
-static inline bool json_read_x_( const strview_t& x, T& _v )
+  if( 0 != _size % 2 ) {
+    throw "Invalid hex data length";
+  }
+  size_t n = _out->size();
+  _out->resize( n + _size / 2 );
+  json_str_to_bin_( &(*_out)[n], _data, _size );
+}
+
+static inline void json_bin_to_str_( std::string& _out, const void* _data, size_t _size )
 {
-  strview_t xx = json_trim_quotes_(x);
-  return X::Read( xx, _v );
+  size_t n = _out.size();
+  _out.resize( n + _size * 2 );
+  json_hex_encode_( (const uint8_t*)_data, _size, &_out[n] );
 }
-template< class T >
-static inline bool json_read_list_( const strview_t& x, T& _v )
+
+/////////////////////////////////////////////////////////// base64 /////////////////////////////////////////////////////////////
+// base64 standard is padded with '=', url-safe (RFC 4648 sec. 5) is not; decoding takes either alphabet, padded or not
+static const uint8_t json_b64_value_[256] = { // 64 - not a base64 char
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 62, 64, 62, 64, 63,
+  52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 64, 64, 64, 64, 64, 64,
+  64,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 64, 64, 64, 64, 63,
+  64, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+  41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+};
+
+static inline size_t json_b64_len_( size_t n, bool _url )
 {
-  strview_t xx = x;
-  json_trim_ch_( xx, '[', ']' );
-  json_trim_ws_( xx );
-  _v.clear();
-  while( !xx.empty() ) {
-    strview_t xv = json_pop_value_( xx );
-    typename T::value_type v;
-    json_read_( xv, v, 0 );
-    _v.push_back( std::move(v) );
-    json_skip_comma_( xx );
-    json_trim_ws_( xx );
-  }
-  return true;
+  return _url ? n / 3 * 4 + (n % 3 ? n % 3 + 1 : 0) : (n + 2) / 3 * 4;
 }
-template< class T >
-static inline bool json_read_( const strview_t& x, std::list<T>& _v, int _dummy )
+
+static inline void json_b64_group_( const char* abc, const uint8_t* p, char* o )
 {
-  return json_read_list_( x, _v );
+  uint32_t v = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+  o[0] = abc[v >> 18];
+  o[1] = abc[(v >> 12) & 0x3f];
+  o[2] = abc[(v >> 6) & 0x3f];
+  o[3] = abc[v & 0x3f];
 }
-template< class T >
-static inline bool json_read_( const strview_t& x, std::vector<T>& _v, int _dummy )
+
+template< class K >
+static inline size_t json_b64_encode_k_( const uint8_t* p, size_t n, char* o, bool _url )
 {
-  return json_read_list_( x, _v );
+  const char* abc = _url ? "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"
+                         : "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  char* o0 = o;
+  size_t i = 0;
+  for( ; i + 3 <= n && i < 6; i += 3, o += 4 ) // the kernel reads 4 bytes back
+    json_b64_group_( abc, p + i, o );
+  size_t k = K::b64_encode( p, i, n, o, _url );
+  o += (k - i) / 3 * 4;
+  for( i = k; i + 3 <= n; i += 3, o += 4 )
+    json_b64_group_( abc, p + i, o );
+  if( i < n ) {
+    uint32_t v = (uint32_t)p[i] << 16 | (i + 1 < n ? (uint32_t)p[i + 1] << 8 : 0);
+    *o++ = abc[v >> 18];
+    *o++ = abc[(v >> 12) & 0x3f];
+    if( i + 1 < n )
+      *o++ = abc[(v >> 6) & 0x3f];
+    else if( !_url )
+      *o++ = '=';
+    if( !_url )
+      *o++ = '=';
+  }
+  return o - o0;
 }
+JSONIO_SIMD_DISPATCH( json_b64_encode_, ( const uint8_t* p, size_t n, char* o, bool _url ), ( p, n, o, _url ) )
 
-static inline bool json_read_string_( const strview_t& x, std::string& _v )
+// decoded size of s[0, n) with padding, 0 if the length can not be base64
+static inline size_t json_b64_decoded_len_( const char* s, size_t& n )
 {
-  strview_t xx = x;
-  strview_t b, a;
-  while( xx.split_by('\\', &b, &a) && !a.empty() ) {
-    _v.append( b.data(), b.size() );
-    switch( a.front() ) {
-    case 'n': _v += '\n'; break;
-    case 't': _v += '\t'; break;
-    case '"': _v += '\"'; break;
-    case '\'': _v += '\''; break;
-    case '\\': _v += '\\'; break;
-    default: throw std::string("unknown escape char: ") + a.front();
-    }
-    a.pop_front();
-    xx = a;
-  }
-  _v.append( xx.data(), xx.size() );
+  if( n >= 1 && '=' == s[n - 1] ) --n;
+  if( n >= 1 && '=' == s[n - 1] ) --n;
+  return (1 == n % 4) ? (size_t)-1 : n / 4 * 3 + (n % 4 ? n % 4 - 1 : 0);
+}
+
+// n without padding, o sized by json_b64_decoded_len_; returns 0 if every char was base64
+template< class K >
+static inline size_t json_b64_decode_k_( const char* s, size_t n, uint8_t* o )
+{
+  unsigned bad = 0;
+  size_t i = K::b64_decode( s, 0, n, o, &bad );
+  if( bad )
+    return bad;
+  uint8_t acc = 0;
+  for( o += i / 4 * 3; i + 4 <= n; i += 4, o += 3 ) {
+    uint8_t a = json_b64_value_[(uint8_t)s[i]], b = json_b64_value_[(uint8_t)s[i + 1]];
+    uint8_t c = json_b64_value_[(uint8_t)s[i + 2]], d = json_b64_value_[(uint8_t)s[i + 3]];
+    acc |= a | b | c | d;
+    uint32_t v = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | d;
+    o[0] = (uint8_t)(v >> 16);
+    o[1] = (uint8_t)(v >> 8);
+    o[2] = (uint8_t)v;
+  }
+  if( i < n ) { // 2 or 3 chars left
+    uint8_t a = json_b64_value_[(uint8_t)s[i]], b = json_b64_value_[(uint8_t)s[i + 1]];
+    uint8_t c = (i + 2 < n) ? json_b64_value_[(uint8_t)s[i + 2]] : 0;
+    acc |= a | b | c;
+    *o++ = (uint8_t)(a << 2 | b >> 4);
+    if( i + 2 < n )
+      *o++ = (uint8_t)(b << 4 | c >> 2);
+  }
+  return acc & 0x40;
+}
+JSONIO_SIMD_DISPATCH( json_b64_decode_, ( const char* s, size_t n, uint8_t* o ), ( s, n, o ) )
+
+// While alive, Bin fields read on this thread with json_bin_stream are taken as _enc, hex otherwise
+struct json_bin_scope_t
+{
+  int prev;
+  explicit json_bin_scope_t( int _enc ) : prev(current()) { current() = _enc; }
+  json_bin_scope_t( const json_bin_scope_t& ) = delete;
+  ~json_bin_scope_t() { current() = prev; }
+
+  static int& current()
+  {
+    static thread_local int s = json_bin_hex;
+    return s;
+  }
+};
+
+static inline void json_bin_encode_( std::string& _out, const void* _data, size_t _size, int _enc )
+{
+  if( json_bin_hex == _enc )
+    return json_bin_to_str_( _out, _data, _size );
+  const bool url = json_bin_base64url == _enc;
+  size_t n = _out.size();
+  _out.resize( n + json_b64_len_( _size, url ) );
+  json_b64_encode_( (const uint8_t*)_data, _size, &_out[n], url );
+}
+
+// into _out of exactly _out_size bytes; false if the data decodes to another size
+static inline bool json_bin_decode_( void* _out, size_t _out_size, const char* _data, size_t _size, int _enc )
+{
+  if( _enc < 0 )
+    _enc = json_bin_scope_t::current();
+  if( json_bin_hex == _enc ) {
+    if( _size != _out_size * 2 )
+      return false;
+    json_str_to_bin_( _out, _data, _size );
+    return true;
+  }
+  if( json_b64_decoded_len_( _data, _size ) != _out_size )
+    return false;
+  if( json_b64_decode_( _data, _size, (uint8_t*)_out ) )
+    throw "Invalid base64 char";
   return true;
 }
 
-struct JsonInBin;
+static inline void json_bin_decode_( std::string* _out, const char* _data, size_t _size, int _enc )
+{
+  if( _enc < 0 )
+    _enc = json_bin_scope_t::current();
+  if( json_bin_hex == _enc )
+    return json_str_to_bin_( _out, _data, _size );
+  size_t len = json_b64_decoded_len_( _data, _size );
+  if( (size_t)-1 == len )
+    throw "Invalid base64 data length";
+  size_t n = _out->size();
+  _out->resize( n + len );
+  if( json_b64_decode_( _data, _size, (uint8_t*)&(*_out)[n] ) )
+    throw "Invalid base64 char";
+}
+
+/////////////////////////////////////////////////////////// json_tape_t /////////////////////////////////////////////////////////////
+
+// Optional structural index of a whole document, built in one pass.
+// Nested JsonIn/JsonInArray walk the tape instead of rescanning the bytes at every level.
+struct json_node_t
+{
+  size_t   kb, ke;  // member name without quotes, empty for array elements and the root
+  size_t   vb, ve;  // raw value, quotes and brackets included
+  uint32_t skip;    // nodes in this subtree including this one, i.e. this + skip is the next sibling
+  uint32_t count;   // number of direct children of an object/array
+};
+
+struct json_tape_t
+{
+  const char* base;
+  std::vector<json_node_t> nodes;
+
+  json_tape_t() : base(nullptr) {}
+  template< typename T >
+  explicit json_tape_t( const T& _x ) : base(nullptr) { parse( _x ); }
+
+  strview_t key( const json_node_t& n ) const { return strview_t( base + n.kb, n.ke - n.kb ); }
+  strview_t value( const json_node_t& n ) const { return strview_t( base + n.vb, n.ve - n.vb ); }
+  const json_node_t* root() const { return nodes.empty() ? nullptr : &nodes[0]; }
+
+  void parse( const strview_t& _x )
+  {
+    base = _x.data();
+    nodes.clear();
+    std::vector<uint32_t> open; // objects/arrays not closed yet
+    const char* p = json_skip_ws_( _x.begin(), _x.end() );
+    const char* e = _x.end();
+    if( p == e )
+      return;
+    for( ;; )
+    {
+      json_node_t n = { 0, 0, 0, 0, 1, 0 };
+      if( !open.empty() && '{' == base[nodes[open.back()].vb] )
+        p = parse_key_( p, e, &n );
+      if( p == e )
+        throw std::string("expected value");
+      n.vb = p - base;
+      const char ch = *p;
+      bool closed = true;
+      if( '{' == ch || '[' == ch ) {
+        p = json_skip_ws_( p + 1, e );
+        closed = false;
+      }
+      else if( is_json_qs_(ch) ) {
+        p += json_find_closing_quote_( strview_t(p, e - p), 1, ch ) + 1;
+        n.ve = p - base;
+      }
+      else {
+        const char* vI = p;
+        for( ; p < e && !is_json_val_end_(*p); ++p ) {}
+        if( p == vI )
+          throw std::string("unexpected char: ") + ch;
+        n.ve = p - base;
+      }
+      if( !open.empty() )
+        nodes[open.back()].count++;
+      nodes.push_back( n );
+      if( !closed ) {
+        open.push_back( (uint32_t)(nodes.size() - 1) );
+        if( p < e && (('{' == ch) ? '}' : ']') == *p )
+          p = close_( p, open );
+        else
+          continue;
+      }
+      // after a value: commas and closing brackets
+      for( ;; )
+      {
+        p = json_skip_ws_( p, e );
+        if( open.empty() ) {
+          if( p != e )
+            throw std::string("unexpected data after json end: ") + *p;
+          return;
+        }
+        const char c2 = ('{' == base[nodes[open.back()].vb]) ? '}' : ']';
+        if( p == e )
+          throw std::string("expected closing ") + c2;
+        if( c2 == *p ) {
+          p = close_( p, open );
+          continue;
+        }
+        if( ',' != *p )
+          throw std::string("expected comma, but found: ") + *p;
+        p = json_skip_ws_( p + 1, e );
+        if( p < e && c2 == *p ) // trailing comma
+          continue;
+        break;
+      }
+    }
+  }
+
+private:
+  const char* parse_key_( const char* p, const char* e, json_node_t* n )
+  {
+    const char* kI = p;
+    const char* kE;
+    if( p < e && is_json_qs_(*p) ) {
+      kE = p + json_find_closing_quote_( strview_t(p, e - p), 1, *p );
+      kI++;
+      p = json_skip_ws_( kE + 1, e );
+      if( p == e || ':' != *p )
+        throw std::string("expected ':'");
+    }
+    else {
+      for( ; p < e && ':' != *p; ++p ) {}
+      if( p == e )
+        throw std::string("expected ':'");
+      for( kE = p; kE > kI && is_json_ws_(*(kE - 1)); --kE ) {}
+    }
+    if( kI == kE ) {
+      throw std::string("param name empty");
+    }
+    n->kb = kI - base;
+    n->ke = kE - base;
+    return json_skip_ws_( p + 1, e );
+  }
+  const char* close_( const char* p, std::vector<uint32_t>& open )
+  {
+    json_node_t& n = nodes[open.back()];
+    n.ve = p + 1 - base;
+    n.skip = (uint32_t)(nodes.size() - open.back());
+    open.pop_back();
+    return p + 1;
+  }
+};
+
+/////////////////////////////////////////////////////////// JsonIn /////////////////////////////////////////////////////////////
+
+// used to workaround incomplete type in gcc/clang
+template< class I, class T > struct use_incomplete { typedef I type; };
+
+// FNV-1a, used by json_params_t once an object outgrows the inline array
+static inline uint32_t json_hash_( const char* s, size_t n )
+{
+  uint32_t h = 2166136261u;
+  for( size_t i = 0; i < n; ++i )
+    h = (h ^ (uint8_t)s[i]) * 16777619u;
+  return h;
+}
+
+// Member name as passed to JsonIn: keeps the length of a literal so no strlen runs per lookup
+struct json_key_t
+{
+  strview_t name;
+
+  template< size_t N >
+  json_key_t( const char (&_n)[N] ) : name(_n, strnlen(_n, N)) {} // a char buffer may hold a shorter name
+  template< class P, class = typename std::enable_if< std::is_same<P, const char*>::value || std::is_same<P, char*>::value >::type >
+  json_key_t( const P& _n ) : name(_n, strlen(_n)) {}
+  json_key_t( const strview_t& _n ) : name(_n) {}
+  json_key_t( const std::string& _n ) : name(_n) {}
+
+  uint32_t hash() const { return json_hash_( name.data(), name.size() ); }
+};
+
+template< int E > struct JsonInBinT;
+typedef JsonInBinT<json_bin_stream> JsonInBin;
 struct JsonInFlags;
 struct JsonInBitFields;
 
+// lets a reader set up per type state before serialize() runs
+template< class S, class T >
+static inline void json_bind_( S& _s, T* _dummy ) {}
+
 struct JsonInValue
 {
   strview_t x;
-  JsonInValue( const strview_t& _x ) : x(_x) {}
+  const json_tape_t* tape; // set when the document was indexed by json_tape_t
+  const json_node_t* t;
+
+  JsonInValue() : tape(nullptr), t(nullptr) {}
+  JsonInValue( const strview_t& _x ) : x(_x), tape(nullptr), t(nullptr) {}
+  JsonInValue( const json_tape_t& _tape, const json_node_t* _t ) : x(_tape.value(*_t)), tape(&_tape), t(_t) {}
+  explicit JsonInValue( const json_tape_t& _tape ) : tape(nullptr), t(nullptr)
+  {
+    if( _tape.root() )
+      *this = JsonInValue( _tape, _tape.root() );
+  }
   const char* data() const { return x.data(); }
   size_t      size() const { return x.size(); }
   bool        isnull() const { return x.isnull(); }
@@ -466,7 +1479,7 @@ struct JsonInValue
 
   template< class T > void operator() ( T& _v ) const
   {
-    json_read_( x, _v, 0 );
+    json_read_( *this, _v, 0 );
     // TODO throw if ret false
   }
 
@@ -478,7 +1491,8 @@ struct JsonInValue
   template< class T, class F >
   void operator() ( T& _v, F _f ) const
   {
-    typename F::io_stream ji(x);
+    typename F::io_stream ji(*this);
+    json_bind_( ji, (typename F::io_type*)nullptr );
     F::io_type::template serialize(ji, _v);
   }
 
@@ -500,6 +1514,13 @@ struct JsonInValue
   {
     strview_t xx = x;
     json_trim_ch_( xx, '{', '}' );
+    if( t ) {
+      for( const json_node_t* c = t + 1; c < t + t->skip; c += c->skip ) {
+        if( tape->key(*c).equal(_n) )
+          return JsonInValue(*tape, c);
+      }
+      return JsonInValue();
+    }
     json_trim_ws_( xx );
     strview_t r = json_enum_params_( xx, [&_n] (const strview_t& p, const strview_t& v)
     {
@@ -513,18 +1534,37 @@ struct JsonInValue
 struct JsonInArray
 {
   strview_t xx;
-  JsonInArray(const strview_t& _x, bool _trim = true) : xx(_x) {
+  const json_tape_t* tape;
+  const json_node_t* t_next;
+  const json_node_t* t_end;
+  size_t t_count;
+  JsonInArray(const strview_t& _x, bool _trim = true) : xx(_x), tape(nullptr), t_next(nullptr), t_end(nullptr), t_count(0) {
     if( _trim ) {
       json_trim_ch_(xx, '[', ']');
       json_trim_ws_(xx);
     }
   }
-  JsonInArray(const JsonInValue& _x, bool _trim = true) : JsonInArray(_x.x, _trim) {}
+  JsonInArray(const JsonInValue& _x, bool _trim = true) : JsonInArray(_x.x, _trim && !_x.t) {
+    if( _x.t ) {
+      json_trim_ch_(xx, '[', ']');
+      tape = _x.tape;
+      t_next = _x.t + 1;
+      t_end = _x.t + _x.t->skip;
+      t_count = _x.t->count;
+    }
+  }
   ~JsonInArray() {}
-  bool empty() { return xx.empty(); }
+  bool empty() { return tape ? t_next == t_end : xx.empty(); }
+  // items in the array, before next() is called: from the tape, otherwise one more scan of the text
+  size_t count() const { return tape ? t_count : json_count_items_( xx ); }
   JsonInValue next()
   {
     ASSERT(!empty());
+    if( tape ) {
+      const json_node_t* n = t_next;
+      t_next += n->skip;
+      return JsonInValue(*tape, n);
+    }
     strview_t xv = json_pop_value_(xx);
     json_skip_comma_(xx);
     json_trim_ws_(xx);
@@ -542,24 +1582,672 @@ struct JsonInArray
   {
     if (empty())
       return false;
-    typename F::io_stream ji(next().x);
+    typename F::io_stream ji(next());
     F::io_type::template serialize(ji, _v);
     return true;
   }
 };
 
+// Members of an object in document order, for maps: next() hands back the name raw, escapes and all
+struct JsonInObject
+{
+  strview_t xx;
+  const json_tape_t* tape;
+  const json_node_t* t_next;
+  const json_node_t* t_end;
+  size_t t_count;
+  JsonInObject(const JsonInValue& _x) : xx(_x.x), tape(nullptr), t_next(nullptr), t_end(nullptr), t_count(0) {
+    if( xx.empty() ) // value was not found
+      return;
+    json_trim_ch_(xx, '{', '}');
+    if( _x.t ) {
+      tape = _x.tape;
+      t_next = _x.t + 1;
+      t_end = _x.t + _x.t->skip;
+      t_count = _x.t->count;
+      return;
+    }
+    json_trim_ws_(xx);
+  }
+  bool empty() const { return tape ? t_next == t_end : xx.empty(); }
+  // members in the object, before next() is called
+  size_t count() const { return tape ? t_count : json_count_items_( xx ); }
+  JsonInValue next(strview_t* _key)
+  {
+    ASSERT(!empty());
+    if( tape ) {
+      const json_node_t* n = t_next;
+      t_next += n->skip;
+      *_key = tape->key(*n);
+      return JsonInValue(*tape, n);
+    }
+    strview_t v;
+    json_next_param_(xx, _key, &v);
+    return JsonInValue(v);
+  }
+};
+
+// Bump allocator for unescaped strview_t fields and readers' scratch memory. reset() rewinds it and keeps
+// the blocks for the next message; with C++17 it is a std::pmr::memory_resource for std::pmr containers.
+struct json_arena_t
+#ifdef JSONIO_PMR
+  : std::pmr::memory_resource
+#endif
+{
+  enum { block_size = 16 * 1024 };
+  std::vector< std::pair<char*, size_t> > blocks;
+  size_t next; // first block not used since reset()
+  char* p;
+  size_t left;
+
+  json_arena_t() : next(0), p(nullptr), left(0) {}
+  json_arena_t( const json_arena_t& ) = delete;
+  json_arena_t& operator = ( const json_arena_t& ) = delete;
+  ~json_arena_t() { clear(); }
+
+  char* alloc( size_t n, size_t align = 1 )
+  {
+    size_t pad = (size_t)(0 - (uintptr_t)p) & (align - 1);
+    if( n + pad > left ) {
+      next_block_( n + align );
+      pad = (size_t)(0 - (uintptr_t)p) & (align - 1);
+    }
+    char* r = p + pad;
+    p = r + n;
+    left -= n + pad;
+    return r;
+  }
+  void reset()
+  {
+    next = 0;
+    p = nullptr;
+    left = 0;
+  }
+  void clear()
+  {
+    for( const auto& b : blocks )
+      delete [] b.first;
+    blocks.clear();
+    reset();
+  }
+
+#ifdef JSONIO_PMR
+protected:
+  void* do_allocate( size_t n, size_t align ) override { return alloc( n, align ); }
+  void do_deallocate( void* _p, size_t n, size_t align ) override {}
+  bool do_is_equal( const std::pmr::memory_resource& _x ) const noexcept override { return this == &_x; }
+#endif
+
+private:
+  void next_block_( size_t _need )
+  {
+    if( next >= blocks.size() || blocks[next].second < _need ) {
+      size_t sz = _need > block_size ? _need : (size_t)block_size;
+      blocks.insert( blocks.begin() + next, std::make_pair( new char[sz], sz ) );
+    }
+    p = blocks[next].first;
+    left = blocks[next].second;
+    ++next;
+  }
+};
+
+struct json_in_place_t {};
+
+// While alive, strview_t fields that need unescaping get it on this thread: into the arena, or in place
+// when the input buffer is writable (each value must then be read only once). Without a scope they throw.
+// Readers made in an arena scope take their scratch memory from the arena too, so it must outlive them.
+struct json_strview_scope_t
+{
+  json_arena_t* arena;
+  json_strview_scope_t* prev;
+
+  explicit json_strview_scope_t( json_arena_t& _arena ) : arena(&_arena), prev(current()) { current() = this; }
+  explicit json_strview_scope_t( json_in_place_t ) : arena(nullptr), prev(current()) { current() = this; }
+  json_strview_scope_t( const json_strview_scope_t& ) = delete;
+  ~json_strview_scope_t() { current() = prev; }
+
+  static json_strview_scope_t*& current()
+  {
+    static thread_local json_strview_scope_t* s = nullptr;
+    return s;
+  }
+};
+
+
+// Allocator of readers' scratch vectors: the arena of the json_strview_scope_t current when it is made, or the heap
+template< class T >
+struct json_scratch_alloc_t
+{
+  typedef T value_type;
+  json_arena_t* arena;
+
+  json_scratch_alloc_t() : arena(json_strview_scope_t::current() ? json_strview_scope_t::current()->arena : nullptr) {}
+  template< class U >
+  json_scratch_alloc_t( const json_scratch_alloc_t<U>& _a ) : arena(_a.arena) {}
+
+  T* allocate( size_t n ) { return arena ? (T*)arena->alloc( n * sizeof(T), alignof(T) ) : (T*)::operator new( n * sizeof(T) ); }
+  void deallocate( T* _p, size_t n ) { if( !arena ) ::operator delete( _p ); }
+  template< class U > bool operator == ( const json_scratch_alloc_t<U>& _a ) const { return arena == _a.arena; }
+  template< class U > bool operator != ( const json_scratch_alloc_t<U>& _a ) const { return arena != _a.arena; }
+};
+
+// Members of one object in document order: a linear scan over an inline array while the object is small,
+// an open-addressing hash over a heap copy after that. The first of duplicate names wins, so a name is
+// resolved the same way whether or not the rest of the object has been read yet.
+struct json_param_t
+{
+  strview_t   first;
+  JsonInValue second;
+};
+
+struct json_params_t
+{
+  enum { inline_n = 16 };
+  typedef const json_param_t* const_iterator;
+
+  json_params_t() : n(0), seen(0), dups(false) {}
+
+  size_t size() const { return n; }
+  bool   has_dups() const { return dups; } // some name came twice
+  bool   empty() const { return 0 == n; }
+  const json_param_t* begin() const { return items(); }
+  const json_param_t* end() const { return items() + n; }
+  const json_param_t& operator [] ( size_t i ) const { ASSERT( i < n ); return items()[i]; }
+
+  const json_param_t* find( const json_key_t& _k ) const
+  {
+    if( slots.empty() ) {
+      for( const json_param_t* pI = begin(); pI != end(); ++pI ) {
+        if( pI->first.equal(_k.name) )
+          return pI;
+      }
+      return end();
+    }
+    size_t mask = slots.size() - 1;
+    for( size_t i = _k.hash() & mask; slots[i]; i = (i + 1) & mask ) {
+      const json_param_t& p = spill[slots[i] - 1];
+      if( p.first.equal(_k.name) )
+        return &p;
+    }
+    return end();
+  }
+
+  void insert( const strview_t& _k, const JsonInValue& _v )
+  {
+    json_param_t p = { _k, _v };
+    if( n < inline_n ) {
+      // names are only compared when one with the same length and last char came before
+      uint64_t bit = (uint64_t)1 << ((_k.size() + (_k.empty() ? 0 : 7 * (uint8_t)_k.back())) & 63);
+      for( size_t i = 0; (seen & bit) && i < n && !dups; ++i )
+        dups = items()[i].first.equal( _k );
+      seen |= bit;
+      new (in_place + n * sizeof(json_param_t)) json_param_t( p );
+      n++;
+      return;
+    }
+    if( slots.empty() ) {
+      spill.reserve( 4 * inline_n );
+      spill.assign( begin(), end() );
+    }
+    spill.push_back( p );
+    n++;
+    if( 2 * n > slots.size() )
+      rehash_( slots.empty() ? 4 * inline_n : 2 * slots.size() );
+    else
+      insert_slot_( n - 1 );
+  }
+
+  void clear() { n = 0; seen = 0; dups = false; spill.clear(); slots.clear(); }
+
+private:
+  size_t n;
+  uint64_t seen; // filter over the inline names
+  bool dups;
+  std::vector< json_param_t, json_scratch_alloc_t<json_param_t> > spill;
+  std::vector< uint32_t, json_scratch_alloc_t<uint32_t> > slots; // index in spill + 1, 0 is an empty slot
+  alignas(json_param_t) char in_place[inline_n * sizeof(json_param_t)];
+
+  const json_param_t* items() const { return slots.empty() ? (const json_param_t*)in_place : spill.data(); }
+
+  void insert_slot_( size_t idx )
+  {
+    size_t mask = slots.size() - 1;
+    const strview_t& k = spill[idx].first;
+    size_t i = json_hash_( k.data(), k.size() ) & mask;
+    for( ; slots[i] && !spill[slots[i] - 1].first.equal(k); i = (i + 1) & mask ) {}
+    if( slots[i] )
+      dups = true; // the earlier one keeps the slot
+    else
+      slots[i] = (uint32_t)(idx + 1);
+  }
+  void rehash_( size_t _cap )
+  {
+    slots.assign( _cap, 0 );
+    for( size_t i = 0; i < spill.size(); ++i )
+      insert_slot_( i );
+  }
+};
+
+// Document position of each field, indexed by the order serialize() asks for them.
+// Learned per type, so the next document of that type is read in one pass even if its members are reordered.
+struct json_order_t
+{
+  enum { max_n = 64 };
+  uint32_t pos[max_n];
+
+  json_order_t() { for( uint32_t i = 0; i < max_n; ++i ) pos[i] = i; }
+
+  template< class T >
+  static json_order_t& of()
+  {
+    static thread_local json_order_t o;
+    return o;
+  }
+};
+
+template< class T >
+static inline bool json_read_( const JsonInValue& x, T& _v, decltype( &T::template serialize<JsonIn,T> ) _dummy )
+{
+  typename use_incomplete<JsonIn, T>::type  ji(x);
+  ji.order = &json_order_t::of<T>();
+  T::serialize( ji, _v );
+  return true;
+}
+template< class T >
+static inline bool json_read_( const JsonInValue& x, T& _v, decltype( &xio<T>::template serialize<JsonIn,T> ) _dummy )
+{
+  typename use_incomplete<JsonIn, T>::type  ji(x);
+  ji.order = &json_order_t::of<T>();
+  xio<T>::serialize( ji, _v );
+  return true;
+}
+template< class T >
+static inline bool json_read_( const JsonInValue& x, T& _v, decltype( &xio<T>::template x2s_map_<x2s_dummy> ) _dummy )
+{
+  strview_t xx = json_trim_quotes_(x.x);
+  return x2s_value_( xx, &_v );
+}
+template< class T >
+static inline bool json_read_( const JsonInValue& x, T& _v, ... )
+{
+  strview_t xx = json_trim_quotes_(x.x);
+  return xio<T>::Read( xx, _v );
+}
+template< class X, class T >
+static inline bool json_read_x_( const strview_t& x, T& _v )
+{
+  strview_t xx = json_trim_quotes_(x);
+  return X::Read( xx, _v );
+}
+template< class R, class T >
+static inline void json_reserve_( R& a, T& _v, decltype( std::declval<T&>().reserve( 0 ) )* _dummy )
+{
+  _v.reserve( a.count() );
+}
+template< class R, class T >
+static inline void json_reserve_( R& a, T& _v, ... ) {}
+
+// Items are parsed straight into the container, which gets its allocator to them
+template< class T >
+static inline bool json_read_list_( const JsonInValue& x, T& _v )
+{
+  JsonInArray a( x );
+  _v.clear();
+  json_reserve_( a, _v, 0 );
+  while( !a.empty() ) {
+    _v.emplace_back();
+    a.next()( _v.back() );
+  }
+  return true;
+}
+template< class T, class A >
+static inline bool json_read_( const JsonInValue& x, std::list<T, A>& _v, int _dummy )
+{
+  return json_read_list_( x, _v );
+}
+template< class T >
+struct json_is_int_ : std::integral_constant< bool, std::is_integral<T>::value && !std::is_same<T, bool>::value && !std::is_same<T, char>::value > {};
+template< class T >
+struct json_is_number_ : std::integral_constant< bool, json_is_int_<T>::value || std::is_same<T, double>::value || std::is_same<T, float>::value > {};
+
+// Arrays of plain numbers in one pass over the text, parsed straight into the storage with no JsonInValue
+// per item. Quoted or nested items, or separators json_read_list_ reads differently, go back to it.
+template< class T >
+static inline bool json_read_numbers_( const JsonInValue& x, T& _v, std::true_type _is_number )
+{
+  typedef typename T::value_type V;
+  strview_t xx = x.x;
+  json_trim_ch_( xx, '[', ']' );
+  json_trim_ws_( xx );
+  _v.clear();
+  // commas only overcount when items are not plain numbers, and those go back anyway
+  _v.reserve( x.t ? x.t->count : xx.empty() ? 0 : 1 + json_count_char_( xx.data(), 0, xx.size(), ',' ) );
+  const char* p = xx.begin();
+  const char* e = xx.end();
+  while( p < e ) {
+    p = json_skip_ws_( p, e );
+    const char* s = p;
+    for( ; p < e && !is_json_val_end_(*p); ++p ) {}
+    if( p == s || is_json_qs_(*s) || '[' == *s || '{' == *s )
+      return json_read_list_( x, _v );
+    _v.emplace_back();
+    strview_t item( s, p - s );
+    xio<V>::Read( item, _v.back() ); // left 0 when not a number, as json_read_list_ does
+    p = json_skip_ws_( p, e );
+    if( p < e ) {
+      if( ',' != *p || ++p == e )
+        return json_read_list_( x, _v );
+    }
+  }
+  return true;
+}
+template< class T >
+static inline bool json_read_numbers_( const JsonInValue& x, T& _v, std::false_type _is_number )
+{
+  return json_read_list_( x, _v );
+}
+template< class T, class A >
+static inline bool json_read_( const JsonInValue& x, std::vector<T, A>& _v, int _dummy )
+{
+  return json_read_numbers_( x, _v, json_is_number_<T>() );
+}
+template< class T, size_t N >
+static inline bool json_read_( const JsonInValue& x, small_vector_t<T, N>& _v, int _dummy )
+{
+  return json_read_numbers_( x, _v, json_is_number_<T>() );
+}
+// Fixed size: items are read in place, more than N throw, fewer leave the rest as it was
+template< class T >
+static inline bool json_read_fixed_( const JsonInValue& x, T* _v, size_t N )
+{
+  JsonInArray a( x );
+  for( size_t i = 0; !a.empty(); ++i ) {
+    if( i == N )
+      throw std::string("too many items for a fixed size array");
+    a.next()( _v[i] );
+  }
+  return true;
+}
+template< class T, size_t N >
+static inline bool json_read_( const JsonInValue& x, std::array<T, N>& _v, int _dummy )
+{
+  return json_read_fixed_( x, _v.data(), N );
+}
+// char[N] is a string, see xio< char [N] >
+template< class T, size_t N >
+static inline typename std::enable_if< !std::is_same<T, char>::value, bool >::type json_read_( const JsonInValue& x, T (&_v)[N], int _dummy )
+{
+  return json_read_fixed_( x, _v, N );
+}
+// "0101" as std::bitset<N>(str) takes it: the last char is bit 0
+template< size_t N >
+static inline bool json_read_( const JsonInValue& x, std::bitset<N>& _v, int _dummy )
+{
+  strview_t s = json_trim_quotes_(x.x);
+  if( s.size() > N )
+    throw std::string("too many bits for std::bitset");
+  _v.reset();
+  for( size_t i = 0; i < s.size(); ++i ) {
+    char ch = s[s.size() - 1 - i];
+    if( '1' == ch )
+      _v.set( i );
+    else if( '0' != ch )
+      throw std::string("expected 0 or 1 in bitset: ") + ch;
+  }
+  return true;
+}
+template< class A >
+static inline bool json_read_( const JsonInValue& x, std::vector<bool, A>& _v, int _dummy )
+{
+  JsonInArray a( x );
+  _v.clear();
+  _v.reserve( a.count() );
+  while( !a.empty() ) {
+    bool v = false;
+    a.next()( v );
+    _v.push_back( v );
+  }
+  return true;
+}
+
+// While alive, strings read on this thread are unescaped strictly: RFC 8259 escapes only, unpaired
+// surrogates, raw control chars and invalid UTF-8 throw. The lenient default also takes \\',
+// a trailing lone backslash, and writes unpaired surrogates as U+FFFD.
+struct json_strict_scope_t
+{
+  bool prev;
+  json_strict_scope_t() : prev(current()) { current() = true; }
+  json_strict_scope_t( const json_strict_scope_t& ) = delete;
+  ~json_strict_scope_t() { current() = prev; }
+
+  static bool& current()
+  {
+    static thread_local bool s = false;
+    return s;
+  }
+};
+
+static inline int json_hex4_( const char* p )
+{
+  int v = 0;
+  for( int i = 0; i < 4; ++i ) {
+    const char c = p[i];
+    int d;
+    if( c >= '0' && c <= '9' ) d = c - '0';
+    else if( c >= 'a' && c <= 'f' ) d = c - 'a' + 10;
+    else if( c >= 'A' && c <= 'F' ) d = c - 'A' + 10;
+    else return -1;
+    v = (v << 4) | d;
+  }
+  return v;
+}
+
+// \\uXXXX at p (past the 'u'), a surrogate pair included; returns the code point, *_p moves past it
+static inline uint32_t json_unescape_u_( const char** _p, const char* e, bool _strict )
+{
+  const char* p = *_p;
+  int c = (e - p >= 4) ? json_hex4_( p ) : -1;
+  if( c < 0 )
+    throw std::string("bad \\u escape");
+  p += 4;
+  uint32_t cp = (uint32_t)c;
+  if( cp >= 0xd800 && cp <= 0xdfff ) {
+    int lo = (cp <= 0xdbff && e - p >= 6 && '\\' == p[0] && 'u' == p[1]) ? json_hex4_( p + 2 ) : -1;
+    if( lo >= 0xdc00 && lo <= 0xdfff ) {
+      cp = 0x10000 + ((cp - 0xd800) << 10) + ((uint32_t)lo - 0xdc00);
+      p += 6;
+    }
+    else if( _strict ) {
+      throw std::string("unpaired surrogate in \\u escape");
+    }
+    else {
+      cp = 0xfffd;
+    }
+  }
+  *_p = p;
+  return cp;
+}
+
+// Unescapes x into out, which has room for x.size() chars and may be x itself. Returns the length.
+// Escapes never grow the text (\\uXXXX is 6 bytes for at most 3 of UTF-8, a pair 12 for 4), so the
+// caller sizes the output to x.size() before the first write.
+static inline size_t json_unescape_( const strview_t& x, char* out, bool _strict )
+{
+  const char* s = x.data();
+  const size_t n = x.size();
+  char* o = out;
+  for( size_t i = 0; i < n; ) {
+    size_t b = json_find_char_( s, i, n, '\\' );
+    if( _strict )
+      json_check_utf8_( s + i, b - i );
+    memmove( o, s + i, b - i );
+    o += b - i;
+    if( b == n )
+      break;
+    if( b + 1 == n ) {
+      if( _strict )
+        throw std::string("unfinished escape");
+      *o++ = '\\';
+      break;
+    }
+    const char* p = s + b + 2;
+    switch( s[b + 1] ) {
+    case '"': *o++ = '"'; break;
+    case '\\': *o++ = '\\'; break;
+    case '/': *o++ = '/'; break;
+    case 'b': *o++ = '\b'; break;
+    case 'f': *o++ = '\f'; break;
+    case 'n': *o++ = '\n'; break;
+    case 'r': *o++ = '\r'; break;
+    case 't': *o++ = '\t'; break;
+    case 'u': o = json_utf8_encode_( o, json_unescape_u_( &p, s + n, _strict ) ); break;
+    case '\'':
+      if( !_strict ) {
+        *o++ = '\'';
+        break;
+      }
+      // fall through
+    default: throw std::string("unknown escape char: ") + s[b + 1];
+    }
+    i = p - s;
+  }
+  return o - out;
+}
+
+template< class S >
+static inline bool json_read_string_( const strview_t& x, S& _v )
+{
+  size_t n = _v.size();
+  _v.resize( n + x.size() );
+  _v.resize( n + json_unescape_( x, &_v[n], json_strict_scope_t::current() ) );
+  return true;
+}
+// any allocator, e.g. std::pmr::string
+template< class Tr, class A >
+static inline bool json_read_( const JsonInValue& x, std::basic_string<char, Tr, A>& _v, int _dummy )
+{
+  _v.clear();
+  return json_read_string_( json_trim_quotes_(x.x), _v );
+}
+
+// No escapes: points into the input. Otherwise unescaped as the current json_strview_scope_t says.
+static inline bool json_read_strview_( const strview_t& x, strview_t& _v )
+{
+  const bool strict = json_strict_scope_t::current();
+  if( json_find_char_( x.data(), 0, x.size(), '\\' ) == x.size() ) {
+    if( strict )
+      json_check_utf8_( x.data(), x.size() );
+    _v = x;
+    return true;
+  }
+  json_strview_scope_t* s = json_strview_scope_t::current();
+  if( !s )
+    throw std::string("strview_t value has escapes, but no json_strview_scope_t");
+  char* out = s->arena ? s->arena->alloc( x.size() ) : (char*)x.data();
+  _v = strview_t( out, json_unescape_( x, out, strict ) );
+  return true;
+}
+
+// map keys from the raw member name
+template< class Tr, class A >
+static inline void json_read_key_( const strview_t& k, std::basic_string<char, Tr, A>& _v )
+{
+  json_read_string_( k, _v );
+}
+static inline void json_read_key_( const strview_t& k, strview_t& _v )
+{
+  json_read_strview_( k, _v );
+}
+template< class K >
+static inline void json_read_key_( const strview_t& k, K& _v )
+{
+  JsonInValue kv( k );
+  kv( _v );
+}
+template< class M >
+static inline typename M::mapped_type& json_map_slot_( M& _m, const strview_t& k, std::false_type _direct )
+{
+  typename M::key_type key;
+  json_read_key_( k, key );
+  return _m[std::move(key)];
+}
+// a name without escapes becomes the key in place, no temporary
+template< class M >
+static inline typename M::mapped_type& json_map_slot_( M& _m, const strview_t& k, std::true_type _direct )
+{
+  if( json_strict_scope_t::current() || json_find_char_( k.data(), 0, k.size(), '\\' ) != k.size() )
+    return json_map_slot_( _m, k, std::false_type() );
+  return _m.emplace( std::piecewise_construct, std::forward_as_tuple( k.data(), k.size() ), std::forward_as_tuple() ).first->second;
+}
+// Values are parsed straight into their slot; a later duplicate name overwrites, like operator[]
+template< class M >
+static inline bool json_read_map_( const JsonInValue& x, M& _m )
+{
+  typedef std::integral_constant< bool, std::is_constructible<typename M::key_type, const char*, size_t>::value > direct;
+  JsonInObject o( x );
+  _m.clear();
+  json_reserve_( o, _m, 0 );
+  strview_t k;
+  while( !o.empty() ) {
+    JsonInValue v = o.next( &k );
+    v( json_map_slot_( _m, k, direct() ) );
+  }
+  return true;
+}
+template< class K, class V, class C, class A >
+static inline bool json_read_( const JsonInValue& x, std::map<K, V, C, A>& _v, int _dummy )
+{
+  return json_read_map_( x, _v );
+}
+template< class K, class V, class H, class E, class A >
+static inline bool json_read_( const JsonInValue& x, std::unordered_map<K, V, H, E, A>& _v, int _dummy )
+{
+  return json_read_map_( x, _v );
+}
+// appended unsorted, keys read in place, then one sort
+template< class K, class V, class C >
+static inline bool json_read_( const JsonInValue& x, flat_map_t<K, V, C>& _v, int _dummy )
+{
+  JsonInObject o( x );
+  _v.clear();
+  _v.reserve( o.count() );
+  strview_t k;
+  while( !o.empty() ) {
+    JsonInValue v = o.next( &k );
+    typename flat_map_t<K, V, C>::value_type& item = _v.emplace_back_unsorted();
+    json_read_key_( k, item.first );
+    v( item.second );
+  }
+  _v.sort();
+  return true;
+}
+
 
 struct JsonIn
 {
   strview_t x;
-  typedef std::map<strview_t, strview_t> params_t;
+  typedef json_params_t params_t;
   params_t params_by_name;
+  const json_tape_t* tape;
+  const json_node_t* t_next; // members not visited yet, when reading from a tape
+  const json_node_t* t_end;
+  json_order_t* order;       // learned member order of the type being read, may be null
+  size_t n_get;              // fields asked so far
+  size_t cursor;             // position after the last member found
 
   static JsonInBinS Bin(std::string& _v) { return JsonInBinS(_v); }
   template< class T >
   static JsonInBinX Bin(T& _v) { return JsonInBinX(_v); }
 
   static XioFunc<JsonInBin, strview_t> Bin() { return XioFunc<JsonInBin, strview_t>(); }
+  static JsonInBinS Base64(std::string& _v) { return JsonInBinS(_v, json_bin_base64); }
+  template< class T >
+  static JsonInBinX Base64(T& _v) { return JsonInBinX(_v, json_bin_base64); }
+  static XioFunc<JsonInBinT<json_bin_base64>, strview_t> Base64() { return XioFunc<JsonInBinT<json_bin_base64>, strview_t>(); }
+  static JsonInBinS Base64Url(std::string& _v) { return JsonInBinS(_v, json_bin_base64url); }
+  template< class T >
+  static JsonInBinX Base64Url(T& _v) { return JsonInBinX(_v, json_bin_base64url); }
+  static XioFunc<JsonInBinT<json_bin_base64url>, strview_t> Base64Url() { return XioFunc<JsonInBinT<json_bin_base64url>, strview_t>(); }
 
   template< class F >
   static XioFunc<F, JsonInFlags> Flags(F _f) { return XioFunc<F, JsonInFlags>(); }
@@ -569,7 +2257,7 @@ struct JsonIn
   static XioFunc<void, JsonInBitFields> BitFields() { return XioFunc<void, JsonInBitFields>(); }
 
   template< typename T >
-  JsonIn( const T& _x ) : x(_x)
+  JsonIn( const T& _x ) : x(_x), tape(nullptr), t_next(nullptr), t_end(nullptr), order(nullptr), n_get(0), cursor(0)
   {
     json_trim_ws_( x );
     if( x.empty() )
@@ -577,13 +2265,19 @@ struct JsonIn
     json_trim_ch_( x, '{', '}' );
     json_trim_ws_( x );
   }
-  JsonIn( const JsonInValue& _x ) : x(_x)
+  JsonIn( const JsonInValue& _x ) : x(_x.x), tape(_x.tape), t_next(nullptr), t_end(nullptr), order(nullptr), n_get(0), cursor(0)
   {
     if( x.empty() ) // value was not found
       return;
     json_trim_ch_( x, '{', '}' );
+    if( _x.t ) {
+      t_next = _x.t + 1;
+      t_end = _x.t + _x.t->skip;
+      return;
+    }
     json_trim_ws_( x );
   }
+  JsonIn( const json_tape_t& _t ) : JsonIn( JsonInValue(_t) ) {}
 
   template< class T > bool operator() ( T& _v ) const
   {
@@ -591,57 +2285,61 @@ struct JsonIn
     return true;
   }
 
-  template< class T > void operator() ( const char* _n, T& _v )
+  template< class T > void operator() ( const json_key_t& _n, T& _v )
   {
     (this->get(_n))( _v );
   }
 
-  void operator() ( const char* _n, JsonInBinS _v )
+  void operator() ( const json_key_t& _n, JsonInBinS _v )
   {
     (this->get(_n))( _v );
   }
-  void operator() ( const char* _n, JsonInBinX _v )
+  void operator() ( const json_key_t& _n, JsonInBinX _v )
   {
     (this->get(_n))( _v );
   }
   template< class T, class S, class F >
-  void operator() ( const char* _n, T& _v, XioFunc<F, S> _f )
+  void operator() ( const json_key_t& _n, T& _v, XioFunc<F, S> _f )
   {
     (this->get(_n))( _v, _f );
   }
   template< class T, class S >
-  void operator() ( const char* _n, T& _v, XioFunc<void, S> _f )
+  void operator() ( const json_key_t& _n, T& _v, XioFunc<void, S> _f )
   {
     (this->get(_n))( _v, XioFunc<T, S>() );
   }
   template< class T, class X >
-  void operator() ( const char* _n, T& _v, xio<X> _f )
+  void operator() ( const json_key_t& _n, T& _v, xio<X> _f )
   {
     json_read_x_< xio<X> >( this->get(_n).x, _v );
   }
 
   void parse()
   {
-    // modify x inside
-    json_enum_params_( x, [this] (const strview_t& p, const strview_t& v)
-    {
-      params_by_name[p] = v; return false;
-    } );
+    while( next_() ) {}
     ASSERT( x.empty() );
   }
 
-  JsonInValue get( const strview_t& _n )
+  // Checks the predicted member first: the learned position for this field, or else the member
+  // right after the previous hit. Documents written by the same serialize() need no lookups at all.
+  // Of duplicate names the first one is read, as json_params_t::find() does.
+  JsonInValue get( const json_key_t& _n )
   {
+    size_t k = n_get++;
+    size_t p = (order && k < json_order_t::max_n) ? order->pos[k] : cursor;
+    while( params_by_name.size() <= p && next_() ) {}
+    if( p < params_by_name.size() && params_by_name[p].first.equal(_n.name) && !params_by_name.has_dups() )
+      return found_( k, p );
     params_t::const_iterator pI = params_by_name.find( _n );
     if( pI != params_by_name.end() )
-      return JsonInValue(pI->second);
-    // modify x inside
-    strview_t r = json_enum_params_( x, [this, &_n] (const strview_t& p, const strview_t& v)
-    {
-      params_by_name[p] = v; return p.equal(_n);
-    } );
-    // TODO throw if r.isnull()
-    return JsonInValue(r);
+      return found_( k, pI - params_by_name.begin() );
+    while( next_() ) {
+      p = params_by_name.size() - 1;
+      if( params_by_name[p].first.equal(_n.name) )
+        return found_( k, p );
+    }
+    // TODO throw
+    return JsonInValue();
   }
 
   template< size_t N >
@@ -651,39 +2349,156 @@ struct JsonIn
   }
 
   explicit operator bool() const { return true; }
+
+private:
+  // reads one more member into params_by_name
+  bool next_()
+  {
+    if( tape ) {
+      if( t_next >= t_end )
+        return false;
+      params_by_name.insert( tape->key(*t_next), JsonInValue(*tape, t_next) );
+      t_next += t_next->skip;
+      return true;
+    }
+    strview_t p, v;
+    if( !json_next_param_( x, &p, &v ) )
+      return false;
+    params_by_name.insert( p, v );
+    return true;
+  }
+  JsonInValue found_( size_t k, size_t p )
+  {
+    if( order && k < json_order_t::max_n )
+      order->pos[k] = (uint32_t)p;
+    cursor = p + 1;
+    return params_by_name[p].second;
+  }
 };
 
 
 
-struct JsonInBin
+template< int E >
+struct JsonInBinT
 {
   template< typename S >
   static void serialize( S& s, std::string& p )
   {
     strview_t x = json_trim_quotes_(s);
-    json_str_to_bin_(&p, x.data(), x.size());
+    json_bin_decode_(&p, x.data(), x.size(), E);
+  }
+};
+
+// Flag names declared by a type's serialize(), learned from the calls of a whole pass, like json_order_t.
+// Once learned, the flag string is tokenized once and each token sets its bit in a mask.
+struct json_flags_t
+{
+  enum { max_n = 64 };
+  std::string names[max_n]; // in declaration order, owned: the names passed in may not outlive the table
+  uint8_t slot[max_n * 2]; // name hash -> index + 1
+  size_t n;
+  bool ready;
+
+  json_flags_t() : n(0), ready(false) {}
+
+  template< class T >
+  static json_flags_t& of()
+  {
+    static thread_local json_flags_t f;
+    return f;
+  }
+
+  // index of _s, or max_n
+  size_t find( const strview_t& _s ) const
+  {
+    for( size_t h = x2s_hash_( _s ); ; ++h ) {
+      uint8_t k = slot[h & (max_n * 2 - 1)];
+      if( !k )
+        return max_n;
+      if( strview_t( names[k - 1] ).equal( _s.data(), _s.size() ) )
+        return k - 1;
+    }
+  }
+
+  void build( size_t _n )
+  {
+    n = _n;
+    ready = n <= max_n;
+    for( uint8_t& s: slot ) s = 0;
+    for( size_t i = 0; ready && i < n; ++i ) {
+      if( find( names[i] ) != max_n ) {
+        ready = false; // declared twice
+        break;
+      }
+      size_t h = x2s_hash_( names[i] );
+      for( ; slot[h & (max_n * 2 - 1)]; ++h ) {}
+      slot[h & (max_n * 2 - 1)] = (uint8_t)(i + 1);
+    }
   }
 };
 
 struct JsonInFlags
 {
   strview_t x;
-  JsonInFlags( const strview_t& _x ) : x(json_trim_quotes_(_x)) {}
+  json_flags_t* table; // set by json_bind_, may be null
+  uint64_t mask;       // bit k - the k-th declared flag is present
+  size_t n_get;        // flags asked so far
+  bool fast;           // mask is valid for this pass
+  bool changed;        // the declarations differ from table
+
+  JsonInFlags( const strview_t& _x ) : x(json_trim_quotes_(_x)), table(nullptr), mask(0), n_get(0), fast(false), changed(false) {}
+  JsonInFlags( const JsonInValue& _x ) : x(json_trim_quotes_(_x.x)), table(nullptr), mask(0), n_get(0), fast(false), changed(false) {}
+  JsonInFlags( const JsonInFlags& ) = delete;
+  ~JsonInFlags()
+  {
+    if( table && (changed || n_get != table->n) )
+      table->build( n_get );
+  }
+
+  void bind( json_flags_t& _t )
+  {
+    table = &_t;
+    fast = _t.ready;
+    if( !fast )
+      return;
+    strview_t xx = x;
+    while( !xx.empty() ) {
+      vpnfc::trim_head_( xx, vpnfc::is_ws_ );
+      const char* b = xx.data();
+      for( ; !xx.empty() && !vpnfc::is_ws_( xx.front() ); xx.pop_front() ) {}
+      size_t k = _t.find( strview_t( b, xx.data() - b ) );
+      if( k < json_flags_t::max_n )
+        mask |= (uint64_t)1 << k;
+    }
+  }
+
+  bool find_flag_slow_( const strview_t& _n ) const
+  {
+    strview_t xx = x;
+    strview_t vx;
+    while( vpnfc::strlist_pop_front(xx, &vx, ' ') ) {
+      if( vx.equal( _n.data(), _n.size() ) )
+        return true;
+    }
+    return false;
+  }
 
   template< size_t N >
   bool find_flag( const char (&_n)[N] )
   {
-    strview_t xx = x;
-    strview_t vx;
-    bool v = false;
-    while( !v && vpnfc::strlist_pop_front(xx, &vx, ' ') ) {
-      v = vx.equal(_n);
-    }
-    if( v && vx.begin() == x.begin() ) {
-      // TODO assume there is no duplicates in x
-      x = xx;
+    strview_t n( _n, strnlen( _n, N ) );
+    size_t k = n_get++;
+    if( table && k < json_flags_t::max_n ) {
+      std::string& d = table->names[k];
+      if( !n.equal( d.data(), d.size() ) ) {
+        d.assign( n.data(), n.size() );
+        changed = true;
+        fast = false;
+      }
     }
-    return v;
+    if( fast && k < table->n )
+      return (mask >> k) & 1;
+    return find_flag_slow_( n );
   }
 
   template<class T, size_t N>
@@ -702,22 +2517,26 @@ struct JsonInFlags
   }
 };
 
+template< class T >
+static inline void json_bind_( JsonInFlags& _s, T* _dummy ) { _s.bind( json_flags_t::of<T>() ); }
+
 struct JsonInBitFields
 {
   JsonIn x;
   JsonInBitFields( const strview_t& _x ) : x(_x) {}
+  JsonInBitFields( const JsonInValue& _x ) : x(_x) {}
 
   template<class T>
-  void operator () ( const char* _n, T& _v, T _bit )
+  void operator () ( const json_key_t& _n, T& _v, T _bit )
   {
-    unsigned v;
+    unsigned v = (_v & _bit) ? 1 : 0; // kept when the member is missing
     (x.get(_n))( v );
     if( v ) _v |= _bit; // set bit
     else _v &= ~_bit; // clear bit
   }
 
   template< class T, class Fi > 
-  void operator() ( const char* _n, const T& _v, Fi _fin )
+  void operator() ( const json_key_t& _n, const T& _v, Fi _fin )
   {
     unsigned v;
     (x.get(_n))( v );
@@ -726,13 +2545,294 @@ struct JsonInBitFields
 };
 
 
+/////////////////////////////////////////////////////////// json_push_parser_t /////////////////////////////////////////////////////////////
+// Incremental json_tape_t builder for chunked input. push() appends a chunk and continues the scan
+// exactly where the previous one stopped (inside a string, number or nested scope), so every byte
+// is looked at once. When the top level value is complete, read() fills an object via serialize().
+// It saves rescans, not memory: buf holds the whole document until reset(), since the serialize()
+// visitors pull members by name in any order and any byte may still be asked for at the end.
+struct json_push_parser_t
+{
+  enum status_t { need_more = 0, done = 1 };
+
+  std::string buf;
+  json_tape_t tape;
+
+  json_push_parser_t() : pos(0) { reset(); }
+
+  status_t push( const strview_t& _chunk )
+  {
+    buf.append( _chunk.data(), _chunk.size() );
+    tape.base = buf.data();
+    return scan_( false );
+  }
+  status_t push( const char* _data, size_t _size ) { return push( strview_t(_data, _size) ); }
+
+  // end of input: completes a bare top level value such as a number
+  status_t finish()
+  {
+    if( done == scan_( true ) )
+      return done;
+    if( st_value_ == st && open.empty() && json_skip_ws_( buf.data() + pos, buf.data() + buf.size() ) == buf.data() + buf.size() )
+      return done; // nothing but whitespace
+    throw std::string("unexpected end of json");
+  }
+
+  bool complete() const { return st_done_ == st; }
+  // input that followed the document
+  strview_t rest() const { return strview_t( buf.data() + pos, buf.size() - pos ); }
+
+  template< class T > void read( T& _v ) const
+  {
+    if( !complete() )
+      throw std::string("json is not complete");
+    JsonInValue root( tape );
+    root( _v );
+  }
+
+  // drops the parsed document, keeps rest() as the start of the next one
+  void reset()
+  {
+    buf.erase( 0, pos );
+    tape.base = buf.data();
+    tape.nodes.clear();
+    open.clear();
+    pos = 0;
+    st = st_value_;
+    esc = false;
+    cur = new_node_();
+  }
+
+private:
+  enum state_t { st_key_, st_key_quoted_, st_key_bare_, st_colon_, st_value_, st_string_, st_scalar_, st_after_, st_done_ };
+  std::vector<uint32_t> open; // objects/arrays not closed yet
+  size_t pos;   // scan position in buf
+  size_t tok;   // start of the key or value being scanned
+  state_t st;
+  bool esc;     // buf[pos] is escaped (chunk ended with an odd backslash run)
+  json_node_t cur;
+
+  static json_node_t new_node_() { json_node_t n = { 0, 0, 0, 0, 1, 0 }; return n; }
+  bool in_object_() const { return '{' == buf[tape.nodes[open.back()].vb]; }
+
+  void add_()
+  {
+    if( !open.empty() )
+      tape.nodes[open.back()].count++;
+    tape.nodes.push_back( cur );
+    cur = new_node_();
+  }
+  void close_()
+  {
+    json_node_t& n = tape.nodes[open.back()];
+    n.ve = pos + 1;
+    n.skip = (uint32_t)(tape.nodes.size() - open.back());
+    open.pop_back();
+    ++pos;
+    st = st_after_;
+  }
+  // closing quote of the string starting at tok, buf.size() if not in yet
+  size_t find_quote_()
+  {
+    const char* s = buf.data();
+    const size_t n = buf.size();
+    if( esc ) {
+      if( pos == n )
+        return n;
+      ++pos;
+      esc = false;
+    }
+    size_t i = json_find_quote_( s, pos, n, s[tok] );
+    if( i < n )
+      return i;
+    size_t k = n;
+    for( ; k > pos && '\\' == s[k - 1]; --k ) {}
+    esc = (n - k) & 1;
+    pos = n;
+    return n;
+  }
+
+  status_t scan_( bool _eof )
+  {
+    const char* s = buf.data();
+    const size_t n = buf.size();
+    for( ;; )
+    {
+      switch( st )
+      {
+      case st_done_:
+        return done;
+      case st_key_:
+        pos = json_skip_ws_( s + pos, s + n ) - s;
+        if( pos == n )
+          return need_more;
+        if( '}' == s[pos] ) { // empty object or trailing comma
+          close_();
+          break;
+        }
+        tok = pos++;
+        st = is_json_qs_(s[tok]) ? st_key_quoted_ : st_key_bare_;
+        break;
+      case st_key_quoted_: {
+        size_t i = find_quote_();
+        if( i == n )
+          return need_more;
+        if( i == tok + 1 )
+          throw std::string("param name empty");
+        cur.kb = tok + 1;
+        cur.ke = i;
+        pos = i + 1;
+        st = st_colon_;
+        break;
+      }
+      case st_key_bare_: {
+        const char* c = (const char*)memchr( s + pos, ':', n - pos );
+        if( !c ) {
+          pos = n;
+          return need_more;
+        }
+        size_t ke = c - s;
+        for( ; ke > tok && is_json_ws_(s[ke - 1]); --ke ) {}
+        if( ke == tok )
+          throw std::string("param name empty");
+        cur.kb = tok;
+        cur.ke = ke;
+        pos = c - s;
+        st = st_colon_;
+        break;
+      }
+      case st_colon_:
+        pos = json_skip_ws_( s + pos, s + n ) - s;
+        if( pos == n )
+          return need_more;
+        if( ':' != s[pos] )
+          throw std::string("expected ':'");
+        ++pos;
+        st = st_value_;
+        break;
+      case st_value_: {
+        pos = json_skip_ws_( s + pos, s + n ) - s;
+        if( pos == n )
+          return need_more;
+        const char ch = s[pos];
+        if( ']' == ch && !open.empty() && !in_object_() ) { // empty array or trailing comma
+          close_();
+          break;
+        }
+        cur.vb = pos;
+        if( '{' == ch || '[' == ch ) {
+          add_();
+          open.push_back( (uint32_t)(tape.nodes.size() - 1) );
+          ++pos;
+          st = ('{' == ch) ? st_key_ : st_value_;
+        }
+        else if( is_json_qs_(ch) ) {
+          tok = pos++;
+          st = st_string_;
+        }
+        else {
+          st = st_scalar_;
+        }
+        break;
+      }
+      case st_string_: {
+        size_t i = find_quote_();
+        if( i == n )
+          return need_more;
+        pos = i + 1;
+        cur.ve = pos;
+        add_();
+        st = st_after_;
+        break;
+      }
+      case st_scalar_:
+        for( ; pos < n && !is_json_val_end_(s[pos]); ++pos ) {}
+        if( pos == n && !_eof )
+          return need_more;
+        if( pos == cur.vb )
+          throw std::string("unexpected char: ") + s[pos];
+        cur.ve = pos;
+        add_();
+        st = st_after_;
+        break;
+      case st_after_:
+        if( open.empty() ) {
+          st = st_done_;
+          return done;
+        }
+        pos = json_skip_ws_( s + pos, s + n ) - s;
+        if( pos == n )
+          return need_more;
+        if( (in_object_() ? '}' : ']') == s[pos] ) {
+          close_();
+          break;
+        }
+        if( ',' != s[pos] )
+          throw std::string("expected comma, but found: ") + s[pos];
+        ++pos;
+        st = in_object_() ? st_key_ : st_value_;
+        break;
+      }
+    }
+  }
+};
+
+
 /////////////////////////////////////////////////////////// JsonOut /////////////////////////////////////////////////////////////
-struct json_out_t
+// Formatting policy: pretty - newlines and tab indent, compact - no whitespace at all;
+// escape - json_escape_default/strict/ascii for strings
+// Output policies; derive to change one knob, e.g. struct b64_t : json_compact_t { enum { bin = json_bin_base64 }; };
+struct json_pretty_t { enum { pretty = 1, escape = json_escape_default, bin = json_bin_hex }; };
+struct json_compact_t { enum { pretty = 0, escape = json_escape_default, bin = json_bin_hex }; };
+
+// Output sink: writers append to buf, which is handed to write() once it grows past limit.
+// Flushing happens only between fields and array items, so a partly written value is never split.
+// The tail is written by the sink destructor; call flush() explicitly to see write errors.
+struct json_sink_t
+{
+  std::string buf;
+  size_t limit;
+  json_sink_t( size_t _limit = 64 * 1024 ) : limit(_limit) { buf.reserve( _limit + _limit / 4 ); }
+  virtual ~json_sink_t() {}
+  virtual void write( const char* _data, size_t _size ) = 0;
+  void flush()
+  {
+    if( buf.empty() )
+      return;
+    write( buf.data(), buf.size() );
+    buf.clear();
+  }
+};
+
+// appends to a string in limit-sized steps
+struct json_string_sink_t : json_sink_t
+{
+  std::string& out;
+  json_string_sink_t( std::string& _out, size_t _limit = 64 * 1024 ) : json_sink_t(_limit), out(_out) {}
+  ~json_string_sink_t() { flush(); }
+  void write( const char* _data, size_t _size ) override { out.append( _data, _size ); }
+};
+
+// hands chunks to f( const char* data, size_t size )
+template< class F >
+struct json_callback_sink_t : json_sink_t
+{
+  F f;
+  json_callback_sink_t( F _f, size_t _limit = 64 * 1024 ) : json_sink_t(_limit), f(_f) {}
+  ~json_callback_sink_t() { try { flush(); } catch( ... ) {} }
+  void write( const char* _data, size_t _size ) override { f( _data, _size ); }
+};
+
+template< class P >
+struct json_out_basic_t
 {
+  typedef P policy;
   std::string& x;
   size_t indent;
-  json_out_t(std::string& _x) : x(_x), indent(0) {}
-  json_out_t(const json_out_t& _x) : x(_x.x), indent(_x.indent + 1) {}
+  json_sink_t* sink;
+  json_out_basic_t(std::string& _x) : x(_x), indent(0), sink(nullptr) {}
+  json_out_basic_t(json_sink_t& _s) : x(_s.buf), indent(0), sink(&_s) {}
+  json_out_basic_t(const json_out_basic_t& _x) : x(_x.x), indent(_x.indent + 1), sink(_x.sink) {}
 
   const char* data() const { return x.data(); }
   size_t size() const { return x.size(); }
@@ -745,12 +2845,115 @@ struct json_out_t
   void operator += ( char _s ) { x += _s; }
   void append( const char *_data, size_t _size ) { x.append(_data, _size); }
 };
+typedef json_out_basic_t<json_pretty_t> json_out_t;
+typedef json_out_basic_t<json_compact_t> json_out_compact_t;
 
-static inline std::string& jostr( json_out_t& _x ) { return _x.x; }
+template< class P > static inline std::string& jostr( json_out_basic_t<P>& _x ) { return _x.x; }
 static inline std::string& jostr( std::string& _x ) { return _x; }
-static inline void joindent( json_out_t& _x ) { _x.x.append( _x.indent, '\t'); }
+template< class P > static inline void joindent( json_out_basic_t<P>& _x ) { if( P::pretty ) _x.x.append( _x.indent, '\t'); }
 static inline void joindent( std::string& _x ) {}
-static inline void joindent_end_scope( json_out_t& _x ) { _x.x += '\n'; if( _x.indent > 1 ) _x.x.append( _x.indent - 1, '\t'); }
+// called on field and item boundaries
+template< class P > static inline void joflush( json_out_basic_t<P>& _x ) { if( _x.sink && _x.x.size() >= _x.sink->limit ) _x.sink->flush(); }
+static inline void joflush( std::string& _x ) {}
+template< class P > static inline void joindent_end_scope( json_out_basic_t<P>& _x )
+{
+  if( !P::pretty )
+    return;
+  _x.x += '\n';
+  if( _x.indent > 1 ) _x.x.append( _x.indent - 1, '\t');
+}
+template< class P > static inline void jobegin_object( json_out_basic_t<P>& _x ) { if( P::pretty ) _x.x += "{\n"; else _x.x += '{'; }
+template< class P > static inline void jofield_sep( json_out_basic_t<P>& _x ) { if( P::pretty ) _x.x += ",\n"; else _x.x += ','; }
+template< class P > static inline void joname_end( json_out_basic_t<P>& _x ) { if( P::pretty ) _x.x += "\": "; else _x.x += "\":"; }
+template< class P > static inline void joitem_sep( json_out_basic_t<P>& _x ) { if( P::pretty ) _x.x += ", "; else _x.x += ','; }
+
+// Integer formatting: digit count from the bit length, two digits per step from a table,
+// written straight into space the output string grew by once
+static const char json_digits2_[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static inline unsigned json_u64_len_( uint64_t v )
+{
+  static const uint64_t pow10[20] = { 0, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+    1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL };
+  unsigned t = ((64 - json_clz64_( v | 1 )) * 1233) >> 12;
+  return t + 1 - (v < pow10[t]);
+}
+
+static inline void json_fmt_u64_( char* e, uint64_t v ) // digits end at e
+{
+  for( ; v >= 100; v /= 100 ) {
+    e -= 2;
+    memcpy( e, json_digits2_ + (v % 100) * 2, 2 );
+  }
+  if( v >= 10 ) {
+    memcpy( e - 2, json_digits2_ + v * 2, 2 );
+  }
+  else {
+    *(e - 1) = (char)('0' + v);
+  }
+}
+
+template< class T >
+static inline size_t json_int_len_( T _v )
+{
+  if( std::is_signed<T>::value && _v < 0 )
+    return 1 + json_u64_len_( 0 - (uint64_t)_v );
+  return json_u64_len_( (uint64_t)_v );
+}
+
+template< class T >
+static inline char* json_fmt_int_( char* p, T _v )
+{
+  uint64_t u = (uint64_t)_v;
+  if( std::is_signed<T>::value && _v < 0 ) {
+    *p++ = '-';
+    u = 0 - u;
+  }
+  p += json_u64_len_( u );
+  json_fmt_u64_( p, u );
+  return p;
+}
+
+template< class S, class T >
+static inline void json_write_int_( S& x, T _v )
+{
+  std::string& s = jostr( x );
+  size_t n = s.size();
+  s.resize( n + json_int_len_( _v ) );
+  json_fmt_int_( &s[n], _v );
+}
+
+// run of array items with one resize, _sep before each item except the very first one
+template< class S, class T, size_t N >
+static inline void json_write_ints_( S& x, const T* _data, size_t _size, bool _first, const char (&_sep)[N] )
+{
+  if( !_size )
+    return;
+  size_t len = (_size - _first) * (N - 1);
+  for( size_t i = 0; i < _size; ++i )
+    len += json_int_len_( _data[i] );
+  std::string& s = jostr( x );
+  size_t n = s.size();
+  s.resize( n + len );
+  char* p = &s[n];
+  for( size_t i = 0; i < _size; ++i ) {
+    if( i || !_first ) {
+      memcpy( p, _sep, N - 1 );
+      p += N - 1;
+    }
+    p = json_fmt_int_( p, _data[i] );
+  }
+  ASSERT( p == s.data() + s.size() );
+}
+template< class S, class T, size_t N >
+static inline typename std::enable_if< json_is_int_<T>::value >::type json_write_numbers_( S& x, const T* _data, size_t _size, bool _first, const char (&_sep)[N] )
+{
+  json_write_ints_( x, _data, _size, _first, _sep );
+}
 
 // decltype( &T::template serialize<JsonOut,T> )
 // decltype( T::serialize(x, _v) )
@@ -758,19 +2961,19 @@ static inline void joindent_end_scope( json_out_t& _x ) { _x.x += '\n'; if( _x.i
 template< class S, class T >
 static inline void json_write_( S& x, const T& _v, decltype( &T::template serialize<JsonOut,T> ) _dummy )
 {
-  typename use_incomplete<JsonOut, T>::type jo(x);
+  typename use_incomplete<JsonOutBasic<typename S::policy>, T>::type jo(x);
   T::serialize( jo, _v );
 }
 template< class S, class T >
 static inline void json_write_( S& x, T& _v, decltype( &T::template serialize<JsonOut,T> ) _dummy )
 {
-  typename use_incomplete<JsonOut, T>::type jo(x);
+  typename use_incomplete<JsonOutBasic<typename S::policy>, T>::type jo(x);
   T::serialize( jo, _v );
 }
 template< class S, class T >
 static inline void json_write_( S& x, const T& _v, decltype( &xio<T>::template serialize<JsonOut,T> ) _dummy )
 {
-  typename use_incomplete<JsonOut, T>::type jo(x);
+  typename use_incomplete<JsonOutBasic<typename S::policy>, T>::type jo(x);
   xio<T>::serialize( jo, _v );
 }
 template< class S, class T >
@@ -814,7 +3017,7 @@ static inline void json_write_array_( S& x, const T& _v )
   x += "[";
   bool first = true;
   for( const auto& v : _v ) {
-    if( first ) { first = false; } else { x += ", "; }
+    if( first ) { first = false; } else { joflush( x ); joitem_sep( x ); }
     json_write_( x, v, 0 );
   }
   x += "]";
@@ -825,49 +3028,250 @@ static inline void json_write_array_x_( S& x, const T& _v )
   x += "[";
   bool first = true;
   for( const auto& v : _v ) {
-    if( first ) { first = false; } else { x += ", "; }
+    if( first ) { first = false; } else { joflush( x ); joitem_sep( x ); }
     json_write_x_<X>( x, v, 0 );
   }
   x += "]";
 }
-template< class S, class T >
-static inline void json_write_( S& x, const std::list<T>& _v, int _dummy )
+template< class S, class T, class A >
+static inline void json_write_( S& x, const std::list<T, A>& _v, int _dummy )
 {
   return json_write_array_( x, _v );
 }
-template< class S, class T >
-static inline void json_write_( S& x, const std::vector<T>& _v, int _dummy )
+template< class V >
+static inline const typename V::value_type* json_data_( const V& _v ) { return _v.data(); }
+template< class T, size_t N >
+static inline const T* json_data_( const T (&_v)[N] ) { return _v; }
+
+// contiguous containers and C arrays
+template< class S, class V >
+static inline void json_write_vector_( S& x, const V& _v, std::false_type _is_number )
 {
   return json_write_array_( x, _v );
 }
-template< class X, class S, class T >
-static inline void json_write_x_( S& x, const std::list<T>& _v, int _dummy )
+template< class S, class V >
+static inline void json_write_vector_( S& x, const V& _v, std::true_type _is_number )
+{
+  // in chunks, so a sink can flush between them
+  const size_t step = 1024;
+  const size_t size = std::end(_v) - std::begin(_v);
+  x += "[";
+  for( size_t i = 0; i < size; i += step ) {
+    size_t n = size - i < step ? size - i : step;
+    joflush( x );
+    if( S::policy::pretty )
+      json_write_numbers_( x, json_data_( _v ) + i, n, 0 == i, ", " );
+    else
+      json_write_numbers_( x, json_data_( _v ) + i, n, 0 == i, "," );
+  }
+  x += "]";
+}
+template< class S, class T, class A >
+static inline void json_write_( S& x, const std::vector<T, A>& _v, int _dummy )
+{
+  return json_write_vector_( x, _v, json_is_number_<T>() );
+}
+template< class S, class T, size_t N >
+static inline void json_write_( S& x, const std::array<T, N>& _v, int _dummy )
+{
+  return json_write_vector_( x, _v, json_is_number_<T>() );
+}
+template< class S, class T, size_t N >
+static inline void json_write_( S& x, const small_vector_t<T, N>& _v, int _dummy )
+{
+  return json_write_vector_( x, _v, json_is_number_<T>() );
+}
+template< class S, class T, size_t N >
+static inline typename std::enable_if< !std::is_same<T, char>::value >::type json_write_( S& x, const T (&_v)[N], int _dummy )
+{
+  return json_write_vector_( x, _v, json_is_number_<T>() );
+}
+template< class S, size_t N >
+static inline void json_write_( S& x, const std::bitset<N>& _v, int _dummy )
+{
+  x += "\"";
+  std::string& o = jostr( x );
+  size_t n = o.size();
+  o.resize( n + N );
+  for( size_t i = 0; i < N; ++i )
+    o[n + i] = _v[N - 1 - i] ? '1' : '0';
+  x += "\"";
+}
+template< class X, class S, class T, class A >
+static inline void json_write_x_( S& x, const std::list<T, A>& _v, int _dummy )
 {
   return json_write_array_x_<X>( x, _v );
 }
-template< class X, class S, class T >
-static inline void json_write_x_( S& x, const std::vector<T>& _v, int _dummy )
+template< class X, class S, class T, class A >
+static inline void json_write_x_( S& x, const std::vector<T, A>& _v, int _dummy )
 {
   return json_write_array_x_<X>( x, _v );
 }
+template< class S > struct json_escape_of_ { enum { value = json_escape_default }; };
+template< class P > struct json_escape_of_< json_out_basic_t<P> > { enum { value = P::escape }; };
+template< class S > struct json_bin_of_ { enum { value = json_bin_hex }; };
+template< class P > struct json_bin_of_< json_out_basic_t<P> > { enum { value = P::bin }; };
+
+static inline char* json_write_u_( char* o, uint32_t c )
+{
+  static const char hex[] = "0123456789abcdef";
+  o[0] = '\\'; o[1] = 'u';
+  o[2] = hex[(c >> 12) & 0xf]; o[3] = hex[(c >> 8) & 0xf]; o[4] = hex[(c >> 4) & 0xf]; o[5] = hex[c & 0xf];
+  return o + 6;
+}
+
+// Escapes the char at s[i], a byte json_find_escape_ stopped at, into o (room for 12 bytes).
+// Returns the end of the output, *_used - input bytes taken.
+static inline char* json_escape_one_( const char* s, size_t i, size_t n, int _mode, char* o, size_t* _used )
+{
+  const uint8_t b = (uint8_t)s[i];
+  *_used = 1;
+  if( b < 0x80 ) {
+    const char c = json_escape_class_[b];
+    if( 'u' == c )
+      return json_write_u_( o, b );
+    o[0] = '\\';
+    o[1] = c;
+    return o + 2;
+  }
+  uint32_t cp;
+  unsigned k = json_utf8_decode_( (const uint8_t*)s + i, (const uint8_t*)s + n, &cp );
+  if( !k )
+    return json_write_u_( o, 0xfffd );
+  *_used = k;
+  if( json_escape_ascii != _mode ) {
+    memcpy( o, s + i, k );
+    return o + k;
+  }
+  if( cp < 0x10000 )
+    return json_write_u_( o, cp );
+  cp -= 0x10000;
+  return json_write_u_( json_write_u_( o, 0xd800 + (cp >> 10) ), 0xdc00 + (cp & 0x3ff) );
+}
+
+// Clean runs are found by a SIMD scan and copied whole; the exact output size is counted first
+// so the string grows once.
 template< class S >
 static void json_write_string_( S& _out, const strview_t& _v )
 {
-  const char* to[] = { "\\\\", "\\\"", "\\n", "\\t" };
-  vpnfc::strview_replace_chars( _v, jostr(_out), "\\\"\n\t", to );
+  const int mode = json_escape_of_<S>::value;
+  const bool hi = json_escape_default != mode;
+  const char* s = _v.data();
+  const size_t n = _v.size();
+  const size_t first = n ? json_find_escape_( s, 0, n, hi ) : n;
+  size_t len = n;
+  char tmp[12];
+  for( size_t i = first; i < n; ) {
+    size_t used;
+    len += (json_escape_one_( s, i, n, mode, tmp, &used ) - tmp) - used;
+    i = json_find_escape_( s, i + used, n, hi );
+  }
+  std::string& out = jostr( _out );
+  size_t o0 = out.size();
+  out.resize( o0 + len );
+  char* o = &out[o0];
+  size_t i = first;
+  for( size_t j = 0; j < n; ) {
+    size_t run = i - j;
+    memcpy( o, s + j, run );
+    o += run;
+    if( i == n )
+      break;
+    size_t used;
+    o = json_escape_one_( s, i, n, mode, o, &used );
+    j = i + used;
+    i = json_find_escape_( s, j, n, hi );
+  }
+  ASSERT( o == out.data() + out.size() );
+}
+// strings directly on the writer, so its policy picks the escape mode
+template< class S >
+static inline void json_write_quoted_( S& x, const strview_t& _v )
+{
+  x += "\"";
+  json_write_string_( x, _v );
+  x += "\"";
+}
+template< class T >
+struct json_is_str_ : std::integral_constant< bool, std::is_same<T, std::string>::value || std::is_same<T, strview_t>::value
+  || std::is_same<T, const char*>::value || std::is_same<T, char*>::value > {};
+template< class Tr, class A >
+struct json_is_str_< std::basic_string<char, Tr, A> > : std::true_type {};
+template< class P, class T >
+static inline typename std::enable_if< json_is_str_<T>::value >::type json_write_( json_out_basic_t<P>& x, const T& _v, int _dummy )
+{
+  json_write_quoted_( x, strview_t(_v) );
+}
+template< class P, size_t N >
+static inline void json_write_( json_out_basic_t<P>& x, const char (&_v)[N], int _dummy ) { json_write_quoted_( x, strview_t(_v, strnlen(_v, N)) ); }
+
+// JsonOutBinX converts from anything, so take it by exact type only
+template< class P, class T >
+static inline typename std::enable_if< std::is_same<T, JsonOutBinX>::value >::type json_write_( json_out_basic_t<P>& x, const T& _v, int _dummy )
+{
+  x += "\"";
+  json_bin_encode_( jostr(x), _v.data(), _v.size(), _v.enc < 0 ? (int)P::bin : _v.enc );
+  x += "\"";
+}
+
+// member names from map keys: strings as they are, enums by name, numbers as their text
+template< class K >
+static inline typename std::enable_if< json_is_str_<K>::value, strview_t >::type json_key_text_( const K& _k, std::string& _tmp, int _dummy )
+{
+  return strview_t(_k);
+}
+template< class K >
+static inline strview_t json_key_text_( const K& _k, std::string& _tmp, decltype( &xio<K>::template x2s_map_<x2s_dummy> ) _dummy )
+{
+  strview_t n;
+  if( !x2s_name_( _k, &n ) )
+    throw "Unknown enum";
+  return n;
+}
+template< class K >
+static inline strview_t json_key_text_( const K& _k, std::string& _tmp, typename xio<K>::is_numeric_type* _dummy )
+{
+  _tmp.clear();
+  xio<K>::Write( _tmp, _k );
+  return _tmp;
+}
+template< class P, class M >
+static inline void json_write_map_( json_out_basic_t<P>& x, const M& _m )
+{
+  typename use_incomplete<JsonOutBasic<P>, M>::type jo(x);
+  std::string tmp;
+  for( const auto& kv : _m )
+    jo.key( json_key_text_( kv.first, tmp, 0 ) )( kv.second );
+}
+template< class P, class K, class V, class C, class A >
+static inline void json_write_( json_out_basic_t<P>& x, const std::map<K, V, C, A>& _v, int _dummy )
+{
+  json_write_map_( x, _v );
+}
+template< class P, class K, class V, class H, class E, class A >
+static inline void json_write_( json_out_basic_t<P>& x, const std::unordered_map<K, V, H, E, A>& _v, int _dummy )
+{
+  json_write_map_( x, _v );
+}
+template< class P, class K, class V, class C >
+static inline void json_write_( json_out_basic_t<P>& x, const flat_map_t<K, V, C>& _v, int _dummy )
+{
+  json_write_map_( x, _v );
 }
 
 
 
-struct JsonOutBin;
-struct JsonOutFlags;
-struct JsonOutBitFields;
+template< int E > struct JsonOutBinT;
+typedef JsonOutBinT<json_bin_stream> JsonOutBin;
+template< class P > struct JsonOutFlagsBasic;
+template< class P > struct JsonOutBitFieldsBasic;
 
-struct JsonOutValue
+template< class P >
+struct JsonOutValueBasic
 {
-  json_out_t& x;
-  //JsonOutValue( std::string& _x ) : x(_x) {}
-  JsonOutValue( json_out_t& _x ) : x(_x) {}
+  json_out_basic_t<P>& x;
+  //JsonOutValueBasic( std::string& _x ) : x(_x) {}
+  JsonOutValueBasic( json_out_basic_t<P>& _x ) : x(_x) {}
 
   template< class T > void operator() ( const T& _v )
   {
@@ -890,43 +3294,54 @@ struct JsonOutValue
   }
 };
 
-struct JsonOutArray
+template< class P >
+struct JsonOutArrayBasic
 {
-  json_out_t x;
+  json_out_basic_t<P> x;
   bool first;
-  JsonOutArray( std::string& _x ) : x(_x), first(true) { x += "["; }
-  JsonOutArray( const json_out_t& _x ) : x(_x), first(true) { x += "["; }
-  JsonOutArray( const JsonOutValue& _x ) : JsonOutArray(_x.x) {}
-  ~JsonOutArray() { x += "]"; }
+  JsonOutArrayBasic( std::string& _x ) : x(_x), first(true) { x += "["; }
+  JsonOutArrayBasic( json_sink_t& _s ) : x(_s), first(true) { x += "["; }
+  JsonOutArrayBasic( const json_out_basic_t<P>& _x ) : x(_x), first(true) { x += "["; }
+  JsonOutArrayBasic( const JsonOutValueBasic<P>& _x ) : JsonOutArrayBasic(_x.x) {}
+  ~JsonOutArrayBasic() { x += "]"; }
   template< class T > void operator() ( const T& _v )
   {
-    if( first ) { first = false; } else { x += ", "; }
+    if( first ) { first = false; } else { joflush( x ); joitem_sep( x ); }
     json_write_(x, _v, 0);
   }
-  JsonOutValue next()
+  JsonOutValueBasic<P> next()
   {
-    if (first) { first = false; } else { x += ", "; }
-    return JsonOutValue(x);
+    if (first) { first = false; } else { joflush( x ); joitem_sep( x ); }
+    return JsonOutValueBasic<P>(x);
   }
 };
 
-struct JsonOut
+template< class P >
+struct JsonOutBasic
 {
-  json_out_t x;
-  JsonOut( std::string& _x ) : x(_x) { x += "{\n"; }
-  JsonOut( const json_out_t& _x ) : x(_x) { x += "{\n"; }
-  JsonOut( const JsonOutValue& _x ) : JsonOut(_x.x) {}
-  ~JsonOut() { joindent_end_scope( x ); x += "}"; }
+  json_out_basic_t<P> x;
+  bool first;
+  JsonOutBasic( std::string& _x ) : x(_x), first(true) { jobegin_object( x ); }
+  JsonOutBasic( json_sink_t& _s ) : x(_s), first(true) { jobegin_object( x ); }
+  JsonOutBasic( const json_out_basic_t<P>& _x ) : x(_x), first(true) { jobegin_object( x ); }
+  JsonOutBasic( const JsonOutValueBasic<P>& _x ) : JsonOutBasic(_x.x) {}
+  ~JsonOutBasic() { joindent_end_scope( x ); x += "}"; }
 
   template< class T >
   static JsonOutBinX Bin(const T& _v) { return JsonOutBinX(_v); }
-  static XioFunc<JsonOutBin, json_out_t&> Bin() { return XioFunc<JsonOutBin, json_out_t&>(); }
+  static XioFunc<JsonOutBin, json_out_basic_t<P>&> Bin() { return XioFunc<JsonOutBin, json_out_basic_t<P>&>(); }
+  template< class T >
+  static JsonOutBinX Base64(const T& _v) { return JsonOutBinX(_v, json_bin_base64); }
+  static XioFunc<JsonOutBinT<json_bin_base64>, json_out_basic_t<P>&> Base64() { return XioFunc<JsonOutBinT<json_bin_base64>, json_out_basic_t<P>&>(); }
+  template< class T >
+  static JsonOutBinX Base64Url(const T& _v) { return JsonOutBinX(_v, json_bin_base64url); }
+  static XioFunc<JsonOutBinT<json_bin_base64url>, json_out_basic_t<P>&> Base64Url() { return XioFunc<JsonOutBinT<json_bin_base64url>, json_out_basic_t<P>&>(); }
   template< class F >
-  static XioFunc<F, JsonOutFlags> Flags(F _f) { return XioFunc<F, JsonOutFlags>(); }
-  static XioFunc<void, JsonOutFlags> Flags() { return XioFunc<void, JsonOutFlags>(); }
+  static XioFunc<F, JsonOutFlagsBasic<P> > Flags(F _f) { return XioFunc<F, JsonOutFlagsBasic<P> >(); }
+  static XioFunc<void, JsonOutFlagsBasic<P> > Flags() { return XioFunc<void, JsonOutFlagsBasic<P> >(); }
   template< class F >
-  static XioFunc<F, JsonOutBitFields> BitFields(F _f) { return XioFunc<F, JsonOutBitFields>(); }
-  static XioFunc<void, JsonOutBitFields> BitFields() { return XioFunc<void, JsonOutBitFields>(); }
+  static XioFunc<F, JsonOutBitFieldsBasic<P> > BitFields(F _f) { return XioFunc<F, JsonOutBitFieldsBasic<P> >(); }
+  static XioFunc<void, JsonOutBitFieldsBasic<P> > BitFields() { return XioFunc<void, JsonOutBitFieldsBasic<P> >(); }
 
   template< class T > void operator() ( const T& _v )
   {
@@ -958,84 +3373,120 @@ struct JsonOut
   }
 
   template< size_t N >
-  JsonOutValue operator() ( const char* (& _n)[N] )
+  JsonOutValueBasic<P> operator() ( const char* (& _n)[N] )
   {
-    if( !is_json_begin_(x) ) {
-      x += ",\n";
+    if( first ) {
+      first = false;
+    }
+    else {
+      joflush( x );
+      jofield_sep( x );
     }
     joindent( x );
     x += "\"";
     for( const char* n: _n ) { x += n; }
-    x += "\": ";
-    return JsonOutValue(x);
+    joname_end( x );
+    return JsonOutValueBasic<P>(x);
   }
-  JsonOutValue operator() ( const char* _n )
+  JsonOutValueBasic<P> operator() ( const char* _n )
   {
     const char* n[] = {_n};
     return (*this)( n );
   }
-  JsonOutArray array( const char* _n )
+  // a name from data, e.g. a map key: escaped as the policy says
+  JsonOutValueBasic<P> key( const strview_t& _n )
+  {
+    if( first ) {
+      first = false;
+    }
+    else {
+      joflush( x );
+      jofield_sep( x );
+    }
+    joindent( x );
+    x += "\"";
+    json_write_string_( x, _n );
+    joname_end( x );
+    return JsonOutValueBasic<P>(x);
+  }
+  JsonOutArrayBasic<P> array( const char* _n )
   {
     (*this)( _n );
-    return JsonOutArray(x);
+    return JsonOutArrayBasic<P>(x);
   }
   explicit operator bool() const { return true; }
 };
 
-struct JsonOutBin
+template< int E >
+struct JsonOutBinT
 {
   template< typename S, typename T >
   static void serialize( S& s, T* p )
   {
     s += "\"";
-    json_bin_to_str_( s, &p, sizeof(p) );
+    json_bin_encode_( jostr(s), &p, sizeof(p), E < 0 ? (int)json_bin_of_<S>::value : E );
     s += "\"";
   }
   template< typename S, typename T >
   static void serialize( S& s, T& p )
   {
     s += "\"";
-    json_bin_to_str_( s, p.data(), p.size() );
+    json_bin_encode_( jostr(s), p.data(), p.size(), E < 0 ? (int)json_bin_of_<S>::value : E );
     s += "\"";
   }
 };
 
-struct JsonOutFlags
+template< class P >
+struct JsonOutFlagsBasic
 {
-  json_out_t x;
-  JsonOutFlags(std::string& _x) : x(_x) { x += '\"'; }
-  JsonOutFlags(json_out_t& _x) : x(_x) { x += '\"'; }
-  ~JsonOutFlags()
+  json_out_basic_t<P> x;
+  JsonOutFlagsBasic(std::string& _x) : x(_x) { x += '\"'; }
+  JsonOutFlagsBasic(json_sink_t& _s) : x(_s) { x += '\"'; }
+  JsonOutFlagsBasic(json_out_basic_t<P>& _x) : x(_x) { x += '\"'; }
+  ~JsonOutFlagsBasic()
   {
     if( x.back() == ' ' ) x.back() = '\"';
     else x += '\"';
   }
 
-  void write_flag( const char* _n, bool _v )
+  void write_flag( const char* _n, size_t _len, bool _v )
   {
     if( !_v )
       return;
-    x += _n;
+    x.append( _n, _len );
     x += ' ';
   }
 
-  template<class T>
-  void operator () ( const char* _n, T _v, T _bit )
+  // a char buffer may hold a shorter name
+  template<class T, size_t N>
+  void operator () ( const char (&_n)[N], T _v, T _bit )
   {
-    write_flag( _n, (_v & _bit) );
+    write_flag( _n, strnlen( _n, N ), (_v & _bit) );
   }
-  template< class T, class Fi > 
-  void operator() ( const char* _n, T _v, Fi _fin )
+  template< class T, class Fi, size_t N >
+  void operator() ( const char (&_n)[N], T _v, Fi _fin )
+  {
+    write_flag( _n, strnlen( _n, N ), !!_v );
+  }
+  template< class C, class T, class = typename std::enable_if< std::is_same<C, const char*>::value || std::is_same<C, char*>::value >::type >
+  void operator () ( const C& _n, T _v, T _bit )
   {
-    write_flag( _n, !!_v );
+    write_flag( _n, strlen( _n ), (_v & _bit) );
+  }
+  template< class C, class T, class Fi, class = typename std::enable_if< std::is_same<C, const char*>::value || std::is_same<C, char*>::value >::type >
+  void operator() ( const C& _n, T _v, Fi _fin )
+  {
+    write_flag( _n, strlen( _n ), !!_v );
   }
 };
 
-struct JsonOutBitFields
+template< class P >
+struct JsonOutBitFieldsBasic
 {
-  JsonOut x;
-  JsonOutBitFields(std::string& _x) : x(_x) {}
-  JsonOutBitFields(json_out_t& _x) : x(_x) {}
+  JsonOutBasic<P> x;
+  JsonOutBitFieldsBasic(std::string& _x) : x(_x) {}
+  JsonOutBitFieldsBasic(json_sink_t& _s) : x(_s) {}
+  JsonOutBitFieldsBasic(json_out_basic_t<P>& _x) : x(_x) {}
 
   template<class T>
   void operator () ( const char* _s, T _v, T _bit )
@@ -1049,6 +3500,14 @@ struct JsonOutBitFields
   }
 };
 
+typedef JsonOutArrayBasic<json_pretty_t> JsonOutArray;
+typedef JsonOutFlagsBasic<json_pretty_t> JsonOutFlags;
+typedef JsonOutBitFieldsBasic<json_pretty_t> JsonOutBitFields;
+
+typedef JsonOutBasic<json_compact_t> JsonOutCompact;
+typedef JsonOutValueBasic<json_compact_t> JsonOutValueCompact;
+typedef JsonOutArrayBasic<json_compact_t> JsonOutArrayCompact;
+
 /////////////////////////////////////////////////////////// xio /////////////////////////////////////////////////////////////
 
 // default serialization -> call target specific static member - serialize()
@@ -1081,10 +3540,9 @@ template<> struct xio< std::string >
 
 template<> struct xio< strview_t >
 {
-  template< class R > static bool Read( R& _in, std::string& _v )
+  template< class R > static bool Read( R& _in, strview_t& _v )
   {
-    _v.clear();
-    return json_read_string_( _in, _v );
+    return json_read_strview_( _in, _v );
   }
   template< class W > static void Write( W& _out, const strview_t& _v )
   {
@@ -1109,7 +3567,7 @@ template<size_t N> struct xio< char [N] >
     if (N <= buf.size())
         return false;
     memcpy(_v, buf.data(), buf.size());
-    buf[buf.size()] = 0;
+    _v[buf.size()] = 0;
     return true;
   }
   template< class W > static void Write( W& _out, const char (&_v)[N] )
@@ -1118,107 +3576,315 @@ template<size_t N> struct xio< char [N] >
   }
 };
 
-template<> struct xio< uint64_t >
+// Integer parsing: eight digits per step with SWAR, exact range check for every width
+static inline bool json_is_8digits_( uint64_t w )
 {
-  typedef void is_numeric_type;
-  template< class R > static bool Read( R& _in, uint64_t& _v )
-  {
-    uint64_t r = 0;
-    for( char c: _in ) {
-      if( !('0' <= c && c <= '9') )
-        return false;
-      r = r * 10 + (c - '0'); // TODO check overflow
-    }
-    _v = r;
-    return true;
+  return 0 == ((w & 0xF0F0F0F0F0F0F0F0ULL) ^ 0x3030303030303030ULL) &&
+         0 == (((w + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) ^ 0x3030303030303030ULL);
+}
+static inline uint32_t json_8digits_( uint64_t w )
+{
+  w -= 0x3030303030303030ULL;
+  w = (w * 10) + (w >> 8); // pairs
+  w = (((w & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+       (((w >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+  return (uint32_t)w;
+}
+static inline uint64_t json_load8_( const char* p )
+{
+  uint64_t w;
+  memcpy( &w, p, 8 );
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  w = __builtin_bswap64( w );
+#endif
+  return w;
+}
+
+static inline bool json_read_u64_( const char* p, const char* e, uint64_t& _v )
+{
+  for( ; e - p > 1 && '0' == *p; ++p ) {} // leading zeros
+  const char* s = p;
+  uint64_t r = 0;
+  // 16 digits at most here, 19 below: neither can overflow
+  for( ; e - p >= 8 && p - s <= 8; p += 8 ) {
+    uint64_t w = json_load8_( p );
+    if( !json_is_8digits_( w ) )
+      break;
+    r = r * 100000000 + json_8digits_( w );
+  }
+  for( ; p < e && p - s < 19; ++p ) {
+    unsigned d = (unsigned)(*p - '0');
+    if( d > 9 )
+      return false;
+    r = r * 10 + d;
   }
-  template< class W > static void Write( W& _out, uint64_t _v )
-  {
-    char buf[64];
-    SNPRINTF(buf, sizeof(buf), "%llu", (unsigned long long)_v);
-    _out += buf;
+  if( p < e ) {
+    unsigned d = (unsigned)(*p - '0');
+    if( e - p > 1 || d > 9 || r > (std::numeric_limits<uint64_t>::max() - d) / 10 )
+      return false; // overflow
+    r = r * 10 + d;
   }
-};
+  _v = r;
+  return true;
+}
 
-template<> struct xio< unsigned >
+template< class T >
+static inline bool json_read_int_( const strview_t& x, T& _v )
 {
-  typedef void is_numeric_type;
-  template< class R > static bool Read( R& _in, unsigned& _v )
-  {
-    uint64_t x;
-    if( !xio<uint64_t>::Read( _in, x ) )
+  const char* p = x.begin();
+  bool neg = false;
+  if( p < x.end() && '-' == *p ) {
+    if( !std::is_signed<T>::value || x.size() == 1 )
       return false;
-    _v = (unsigned)x;
-    return true;
+    neg = true;
+    p++;
   }
-  template< class W > static void Write( W& _out, unsigned _v )
-  {
-    return xio<uint64_t>::Write( _out, (uint64_t)_v );
-  }
-};
+  uint64_t r;
+  if( !json_read_u64_( p, x.end(), r ) )
+    return false;
+  const uint64_t max = (uint64_t)std::numeric_limits<T>::max();
+  if( r > max + neg ) // -min == max + 1
+    return false;
+  _v = neg ? (T)(0 - r) : (T)r;
+  return true;
+}
 
-template<> struct xio< uint16_t >
+template< class T >
+struct json_xio_int_
 {
   typedef void is_numeric_type;
-  template< class R > static bool Read(R& _in, uint16_t& _v)
+  template< class R > static bool Read( R& _in, T& _v )
   {
-    uint64_t x;
-    if (!xio<uint64_t>::Read(_in, x))
-      return false;
-    _v = (uint16_t)x;
-    return true;
+    return json_read_int_( _in, _v );
   }
-  template< class W > static void Write(W& _out, uint16_t _v)
+  template< class W > static void Write( W& _out, T _v )
   {
-    return xio<uint64_t>::Write(_out, (uint64_t)_v);
+    json_write_int_( _out, _v );
   }
 };
 
-template<> struct xio<int64_t>
+// on the fundamental types so every intN_t, long and size_t alias maps to exactly one of them
+template<> struct xio< signed char > : json_xio_int_< signed char > {};
+template<> struct xio< unsigned char > : json_xio_int_< unsigned char > {};
+template<> struct xio< short > : json_xio_int_< short > {};
+template<> struct xio< unsigned short > : json_xio_int_< unsigned short > {};
+template<> struct xio< int > : json_xio_int_< int > {};
+template<> struct xio< unsigned > : json_xio_int_< unsigned > {};
+template<> struct xio< long > : json_xio_int_< long > {};
+template<> struct xio< unsigned long > : json_xio_int_< unsigned long > {};
+template<> struct xio< long long > : json_xio_int_< long long > {};
+template<> struct xio< unsigned long long > : json_xio_int_< unsigned long long > {};
+
+// Floating point: shortest text that reads back to the same value, '.' regardless of locale.
+// Reading takes the exact fast path (decimal mantissa and power of ten both exact in T) and falls back
+// to std::from_chars or strtod only for long mantissas and large exponents.
+template< class T > struct json_float_traits_;
+template<> struct json_float_traits_< double >
+{
+  enum { mant_bits = 53, max_exp10 = 22, min_prec = 15, max_prec = 17 };
+  static double pow10( int i )
+  {
+    static const double p[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    return p[i];
+  }
+  static double strto( const char* s, char** e ) { return strtod( s, e ); }
+};
+template<> struct json_float_traits_< float >
 {
-  typedef void is_numeric_type;
-  template< class R > static bool Read(R& _in, int64_t& _v)
+  enum { mant_bits = 24, max_exp10 = 10, min_prec = 6, max_prec = 9 };
+  static float pow10( int i )
   {
-    uint64_t r = 0;
-    bool first = true, neg = false;
-    for (char c : _in) {
-      if (first && c == '-')
-        neg = true;
+    static const float p[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+    return p[i];
+  }
+  static float strto( const char* s, char** e ) { return strtof( s, e ); }
+};
+
+static inline char json_locale_point_()
+{
+  const char* dp = localeconv()->decimal_point;
+  return (dp && *dp) ? *dp : '.';
+}
+
+template< class T >
+static inline bool json_read_float_slow_( const char* p, const char* e, T& _v )
+{
+#ifdef JSONIO_TO_CHARS
+  std::from_chars_result r = std::from_chars( p, e, _v );
+  return r.ptr == e && std::errc() == r.ec;
+#else
+  std::string buf( p, e );
+  char dp = json_locale_point_();
+  for( char& c: buf ) {
+    if( '.' == c )
+      c = dp;
+  }
+  char* end;
+  errno = 0;
+  T v = json_float_traits_<T>::strto( buf.c_str(), &end );
+  if( end != buf.c_str() + buf.size() || (ERANGE == errno && (v > 1 || v < -1)) ) // overflow is rejected like from_chars does
+    return false;
+  _v = v;
+  return true;
+#endif
+}
+
+template< class T >
+static inline bool json_read_float_( const strview_t& x, T& _v )
+{
+  typedef json_float_traits_<T> tr;
+  const char* p = x.begin();
+  const char* e = x.end();
+  if( x.equal("null") ) { // written for nan and inf
+    _v = std::numeric_limits<T>::quiet_NaN();
+    return true;
+  }
+  bool neg = p < e && '-' == *p;
+  p += neg;
+  uint64_t m = 0;
+  int nd = 0, exp10 = 0;
+  bool exact = true;
+  const char* dI = p;
+  for( ; p < e && (unsigned)(*p - '0') <= 9; ++p ) {
+    if( nd < 19 ) {
+      m = m * 10 + (unsigned)(*p - '0');
+      nd += (0 != m);
+    }
+    else {
+      exp10++;
+      exact = false;
+    }
+  }
+  bool has_digits = p != dI;
+  if( p < e && '.' == *p ) {
+    const char* fI = ++p;
+    for( ; p < e && (unsigned)(*p - '0') <= 9; ++p ) {
+      if( nd < 19 ) {
+        m = m * 10 + (unsigned)(*p - '0');
+        nd += (0 != m);
+        exp10--;
+      }
       else {
-        if (!('0' <= c && c <= '9'))
-          return false;
-        r = r * 10 + (c - '0'); // TODO check overflow
+        exact = false;
       }
-      first = false;
     }
-    _v = neg ? r * -1 : r;
-    return true;
+    if( p == fI )
+      return false;
+    has_digits = true;
   }
-  template< class W > static void Write(W& _out, int64_t _v)
-  {
-    char buf[64];
-    SNPRINTF(buf, sizeof(buf), "%lld", (long long)_v);
-    _out += buf;
+  if( !has_digits )
+    return false;
+  if( p < e && ('e' == *p || 'E' == *p) ) {
+    ++p;
+    bool eneg = p < e && '-' == *p;
+    p += (p < e && ('-' == *p || '+' == *p));
+    const char* eI = p;
+    int ex = 0;
+    for( ; p < e && (unsigned)(*p - '0') <= 9; ++p ) {
+      if( ex < 100000 )
+        ex = ex * 10 + (*p - '0');
+    }
+    if( p == eI )
+      return false;
+    exp10 += eneg ? -ex : ex;
   }
-};
+  if( p != e )
+    return false;
+  const uint64_t max_m = 1ULL << tr::mant_bits;
+  if( exact && m <= max_m ) {
+    if( 0 == m ) {
+      _v = neg ? -(T)0 : (T)0;
+      return true;
+    }
+    if( exp10 > tr::max_exp10 && exp10 <= tr::max_exp10 + 19 ) {
+      // move the excess exponent into the mantissa while it stays exact
+      for( ; exp10 > tr::max_exp10 && m * 10 <= max_m; --exp10 ) { m *= 10; }
+    }
+    if( -tr::max_exp10 <= exp10 && exp10 <= tr::max_exp10 ) {
+      T v = (T)m;
+      v = (exp10 < 0) ? v / tr::pow10( -exp10 ) : v * tr::pow10( exp10 );
+      _v = neg ? -v : v;
+      return true;
+    }
+  }
+  return json_read_float_slow_( x.begin(), x.end(), _v );
+}
+
+enum { json_float_max_len = 32 }; // "-1.7976931348623157e+308" with room to spare
+
+template< class T >
+static inline char* json_fmt_float_( char* p, T _v )
+{
+  if( !(_v == _v) || _v - _v != 0 ) { // nan, inf
+    memcpy( p, "null", 4 );
+    return p + 4;
+  }
+#ifdef JSONIO_TO_CHARS
+  return std::to_chars( p, p + json_float_max_len, _v ).ptr;
+#else
+  typedef json_float_traits_<T> tr;
+  char buf[64];
+  int n = 0;
+  for( int prec = tr::min_prec; prec <= tr::max_prec; ++prec ) {
+    n = SNPRINTF( buf, sizeof(buf), "%.*g", prec, (double)_v );
+    if( tr::strto( buf, nullptr ) == _v )
+      break;
+  }
+  char dp = json_locale_point_();
+  for( int i = 0; i < n; ++i ) {
+    if( dp == buf[i] )
+      buf[i] = '.';
+  }
+  memcpy( p, buf, n );
+  return p + n;
+#endif
+}
+
+template< class S, class T >
+static inline void json_write_float_( S& x, T _v )
+{
+  char buf[json_float_max_len];
+  jostr( x ).append( buf, json_fmt_float_( buf, _v ) - buf );
+}
+
+// as json_write_ints_: one resize to the longest the items can be, cut back after
+template< class S, class T, size_t N >
+static inline typename std::enable_if< std::is_floating_point<T>::value >::type json_write_numbers_( S& x, const T* _data, size_t _size, bool _first, const char (&_sep)[N] )
+{
+  if( !_size )
+    return;
+  std::string& s = jostr( x );
+  size_t n = s.size();
+  s.resize( n + _size * (json_float_max_len + N - 1) );
+  char* p = &s[n];
+  for( size_t i = 0; i < _size; ++i ) {
+    if( i || !_first ) {
+      memcpy( p, _sep, N - 1 );
+      p += N - 1;
+    }
+    p = json_fmt_float_( p, _data[i] );
+  }
+  s.resize( p - s.data() );
+}
 
-template<> struct xio<int32_t>
+template< class T >
+struct json_xio_float_
 {
   typedef void is_numeric_type;
-  template< class R > static bool Read(R& _in, int32_t& _v)
+  template< class R > static bool Read( R& _in, T& _v )
   {
-    int64_t x;
-    if (!xio<int64_t>::Read(_in, x))
-      return false;
-    _v = (int32_t)x;
-    return true;
+    return json_read_float_( _in, _v );
   }
-  template< class W > static void Write(W& _out, int32_t _v)
+  template< class W > static void Write( W& _out, T _v )
   {
-    return xio<int64_t>::Write(_out, (int64_t)_v);
+    json_write_float_( _out, _v );
   }
 };
 
+template<> struct xio< double > : json_xio_float_< double > {};
+template<> struct xio< float > : json_xio_float_< float > {};
+
 template<> struct xio< bool >
 {
   typedef void is_numeric_type;
@@ -1252,7 +3918,7 @@ template<> struct xio< JsonInBinS >
 {
   template< class R > static bool Read( R& _in, JsonInBinS& _v )
   {
-    json_str_to_bin_( &_v.v, _in.data(), _in.size() );
+    json_bin_decode_( &_v.v, _in.data(), _in.size(), _v.enc );
     return true;
   }
 };
@@ -1261,11 +3927,7 @@ template<> struct xio< JsonInBinX >
 {
   template< class R > static bool Read( R& _in, JsonInBinX& _v )
   {
-    if( _in.size() != _v.v_size * 2 ) {
-      return false; //throw "Invalid bin data length";
-    }
-    json_str_to_bin_( _v.v_data, _in.data(), _in.size() );
-    return true;
+    return json_bin_decode_( _v.v_data, _v.v_size, _in.data(), _in.size(), _v.enc ); // false on a size mismatch
   }
 };
 
@@ -1273,7 +3935,7 @@ template<> struct xio< JsonOutBinX >
 {
   template< class W > static void Write( W& _out, const JsonOutBinX& _v )
   {
-    json_bin_to_str_( _out, _v.data(), _v.size() );
+    json_bin_encode_( jostr(_out), _v.data(), _v.size(), _v.enc < 0 ? (int)json_bin_hex : _v.enc );
   }
 };
 
@@ -0,0 +1,167 @@
+#ifndef __JSONIO_FILE_H
+#define __JSONIO_FILE_H
+
+#include <cstdio>
+#include <utility>
+#include "jsonio.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define JSONIO_POSIX 1
+#endif
+
+
+/////////////////////////////////////////////////////////// sinks /////////////////////////////////////////////////////////////
+struct json_file_sink_t : json_sink_t
+{
+  FILE* f;
+  json_file_sink_t( FILE* _f, size_t _limit = 64 * 1024 ) : json_sink_t(_limit), f(_f) {}
+  ~json_file_sink_t() { try { flush(); } catch( ... ) {} }
+  void write( const char* _data, size_t _size ) override
+  {
+    if( fwrite( _data, 1, _size, f ) != _size )
+      throw std::string("json: fwrite failed");
+  }
+};
+
+#ifdef JSONIO_POSIX
+struct json_fd_sink_t : json_sink_t
+{
+  int fd;
+  json_fd_sink_t( int _fd, size_t _limit = 64 * 1024 ) : json_sink_t(_limit), fd(_fd) {}
+  ~json_fd_sink_t() { try { flush(); } catch( ... ) {} }
+  void write( const char* _data, size_t _size ) override
+  {
+    while( _size ) {
+      ssize_t n = ::write( fd, _data, _size );
+      if( n < 0 ) {
+        if( EINTR == errno )
+          continue;
+        throw std::string("json: write failed");
+      }
+      _data += n;
+      _size -= (size_t)n;
+    }
+  }
+};
+#endif
+
+
+/////////////////////////////////////////////////////////// json_file_map_t /////////////////////////////////////////////////////////////
+// View of a whole file: mmap where available, otherwise a copy read with stdio.
+// Values read as strview_t point into it, so keep it alive for as long as they are used.
+// The mapping is private and writable, so in-place unescaping changes this process' pages, never the file.
+struct json_file_map_t
+{
+  const char* data_;
+  size_t size_;
+#ifndef JSONIO_POSIX
+  std::vector<char> copy_; // heap storage: data_ stays valid across swap() and moves
+#endif
+
+  json_file_map_t() : data_(nullptr), size_(0) {}
+  explicit json_file_map_t( const char* _path ) : data_(nullptr), size_(0) { open( _path ); }
+  json_file_map_t( json_file_map_t&& _x ) : data_(nullptr), size_(0) { swap( _x ); }
+  json_file_map_t& operator = ( json_file_map_t&& _x ) { swap( _x ); return *this; }
+  json_file_map_t( const json_file_map_t& ) = delete;
+  json_file_map_t& operator = ( const json_file_map_t& ) = delete;
+  ~json_file_map_t() { close(); }
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  strview_t view() const { return strview_t( data_, size_ ); }
+
+  void swap( json_file_map_t& _x )
+  {
+    std::swap( data_, _x.data_ );
+    std::swap( size_, _x.size_ );
+#ifndef JSONIO_POSIX
+    copy_.swap( _x.copy_ );
+#endif
+  }
+
+#ifdef JSONIO_POSIX
+  void open( const char* _path )
+  {
+    close();
+    int fd = ::open( _path, O_RDONLY );
+    if( fd < 0 )
+      throw std::string("json: cannot open ") + _path;
+    struct stat st;
+    if( fstat( fd, &st ) != 0 ) {
+      ::close( fd );
+      throw std::string("json: cannot stat ") + _path;
+    }
+    if( st.st_size > 0 ) {
+      // copy-on-write: a json_strview_scope_t( json_in_place_t() ) unescapes strings where they are
+      void* p = mmap( nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+      if( MAP_FAILED == p ) {
+        ::close( fd );
+        throw std::string("json: cannot map ") + _path;
+      }
+      // hints only, failures are fine
+      madvise( p, (size_t)st.st_size, MADV_SEQUENTIAL );
+#ifdef MADV_HUGEPAGE
+      madvise( p, (size_t)st.st_size, MADV_HUGEPAGE );
+#endif
+      data_ = (const char*)p;
+      size_ = (size_t)st.st_size;
+    }
+    ::close( fd ); // the mapping keeps the file
+  }
+  void close()
+  {
+    if( data_ )
+      munmap( (void*)data_, size_ );
+    data_ = nullptr;
+    size_ = 0;
+  }
+#else
+  void open( const char* _path )
+  {
+    close();
+    FILE* f = fopen( _path, "rb" );
+    if( !f )
+      throw std::string("json: cannot open ") + _path;
+    char tmp[64 * 1024];
+    for( size_t n; (n = fread( tmp, 1, sizeof(tmp), f )) > 0; )
+      copy_.insert( copy_.end(), tmp, tmp + n );
+    bool failed = ferror( f ) != 0;
+    fclose( f );
+    if( failed )
+      throw std::string("json: cannot read ") + _path;
+    data_ = copy_.data();
+    size_ = copy_.size();
+  }
+  void close()
+  {
+    copy_.clear();
+    data_ = nullptr;
+    size_ = 0;
+  }
+#endif
+};
+
+// Parses the file straight from the mapping. The returned map owns the bytes any strview_t in _v points to.
+// Works under an in-place json_strview_scope_t too: unescaped strings land in private copies of the pages.
+template< class T >
+static inline json_file_map_t json_read_file( const char* _path, T& _v )
+{
+  json_file_map_t m( _path );
+  strview_t x = m.view();
+  json_trim_ws_( x ); // files usually end with a newline
+  JsonInValue root( x );
+  root( _v );
+  return m;
+}
+template< class T >
+static inline json_file_map_t json_read_file( const std::string& _path, T& _v )
+{
+  return json_read_file( _path.c_str(), _v );
+}
+
+
+#endif // __JSONIO_FILE_H
@@ -0,0 +1,1016 @@
+#ifndef __MSGPACKIO_H
+#define __MSGPACKIO_H
+
+#include "jsonio.h"
+
+
+// MessagePack streams for the same serialize() visitors as JsonIn/JsonOut:
+//   std::string buf; { MsgPackOut mo(buf); T::serialize(mo, v); }
+//   MsgPackIn mi(buf); T::serialize(mi, v);
+// Objects are maps keyed by member name, so members can be added, dropped or reordered like in json.
+// Numbers keep their binary form, strings and Bin fields are length prefixed raw bytes (no escapes,
+// no hex), Flags are the same space separated names as in json, enums are written by name.
+
+/////////////////////////////////////////////////////////// encoding /////////////////////////////////////////////////////////////
+enum { msgpack_nil, msgpack_bool, msgpack_uint, msgpack_int, msgpack_float, msgpack_str, msgpack_bin, msgpack_array, msgpack_map, msgpack_ext };
+
+// a value's header
+struct msgpack_item_t
+{
+  int type;
+  uint64_t u;    // bool and integers (int as two's complement), bytes of str/bin/ext, items of array/map
+  double d;      // float
+  const char* p; // str/bin/ext bytes, the first item of array/map, past the value otherwise
+};
+
+static inline uint64_t msgpack_get_be_( const char* p, int n )
+{
+  uint64_t v = 0;
+  for( int i = 0; i < n; ++i )
+    v = (v << 8) | (uint8_t)p[i];
+  return v;
+}
+static inline void msgpack_set_be_( char* p, uint64_t v, int n )
+{
+  for( int i = n - 1; i >= 0; --i, v >>= 8 )
+    p[i] = (char)(uint8_t)v;
+}
+static inline void msgpack_put_( std::string& x, uint8_t tag, uint64_t v, int n )
+{
+  char b[9];
+  b[0] = (char)tag;
+  msgpack_set_be_( b + 1, v, n );
+  x.append( b, n + 1 );
+}
+
+static inline void msgpack_need_( const char* p, const char* e, uint64_t n )
+{
+  if( (uint64_t)(e - p) < n )
+    throw std::string("msgpack: unexpected end");
+}
+
+static inline void msgpack_item_( const char* p, const char* e, msgpack_item_t* _i )
+{
+  msgpack_need_( p, e, 1 );
+  const uint8_t c = (uint8_t)*p++;
+  int len = 0; // bytes of the length or value after the tag
+  _i->u = 0;
+  _i->d = 0;
+  if( c < 0x80 ) { _i->type = msgpack_uint; _i->u = c; }
+  else if( c < 0x90 ) { _i->type = msgpack_map; _i->u = c & 0x0f; }
+  else if( c < 0xa0 ) { _i->type = msgpack_array; _i->u = c & 0x0f; }
+  else if( c < 0xc0 ) { _i->type = msgpack_str; _i->u = c & 0x1f; }
+  else if( c >= 0xe0 ) { _i->type = msgpack_int; _i->u = (uint64_t)(int64_t)(int8_t)c; }
+  else {
+    switch( c ) {
+    case 0xc0: _i->type = msgpack_nil; break;
+    case 0xc2: case 0xc3: _i->type = msgpack_bool; _i->u = c & 1; break;
+    case 0xc4: case 0xc5: case 0xc6: _i->type = msgpack_bin; len = 1 << (c - 0xc4); break;
+    case 0xc7: case 0xc8: case 0xc9: _i->type = msgpack_ext; len = 1 << (c - 0xc7); break;
+    case 0xca: case 0xcb: _i->type = msgpack_float; len = 4 << (c - 0xca); break;
+    case 0xcc: case 0xcd: case 0xce: case 0xcf: _i->type = msgpack_uint; len = 1 << (c - 0xcc); break;
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3: _i->type = msgpack_int; len = 1 << (c - 0xd0); break;
+    case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8: _i->type = msgpack_ext; _i->u = 1u << (c - 0xd4); break;
+    case 0xd9: case 0xda: case 0xdb: _i->type = msgpack_str; len = 1 << (c - 0xd9); break;
+    case 0xdc: case 0xdd: _i->type = msgpack_array; len = 2 << (c - 0xdc); break;
+    case 0xde: case 0xdf: _i->type = msgpack_map; len = 2 << (c - 0xde); break;
+    default: throw std::string("msgpack: bad tag");
+    }
+  }
+  if( len ) {
+    msgpack_need_( p, e, len );
+    _i->u = msgpack_get_be_( p, len );
+    p += len;
+    if( msgpack_int == _i->type && len < 8 ) { // sign extend
+      const int s = 64 - 8 * len;
+      _i->u = (uint64_t)((int64_t)(_i->u << s) >> s);
+    }
+    if( msgpack_float == _i->type ) {
+      if( 4 == len ) { uint32_t b = (uint32_t)_i->u; float f; memcpy( &f, &b, 4 ); _i->d = f; }
+      else { memcpy( &_i->d, &_i->u, 8 ); }
+    }
+  }
+  if( msgpack_ext == _i->type ) {
+    msgpack_need_( p, e, 1 );
+    p++; // ext type
+  }
+  if( msgpack_str == _i->type || msgpack_bin == _i->type || msgpack_ext == _i->type )
+    msgpack_need_( p, e, _i->u );
+  // every item takes a byte at least, so a count can not run past the input
+  if( msgpack_array == _i->type )
+    msgpack_need_( p, e, _i->u );
+  if( msgpack_map == _i->type )
+    msgpack_need_( p, e, 2 * _i->u );
+  _i->p = p;
+}
+
+enum { msgpack_max_depth = 512 };
+
+// end of the value at p
+static inline const char* msgpack_skip_( const char* p, const char* e, int _depth = 0 )
+{
+  msgpack_item_t i;
+  msgpack_item_( p, e, &i );
+  switch( i.type ) {
+  case msgpack_str: case msgpack_bin: case msgpack_ext:
+    return i.p + i.u;
+  case msgpack_array: case msgpack_map:
+    if( _depth > msgpack_max_depth )
+      throw std::string("msgpack: nesting too deep");
+    p = i.p;
+    for( uint64_t k = (msgpack_map == i.type ? 2 : 1) * i.u; k; --k )
+      p = msgpack_skip_( p, e, _depth + 1 );
+    return p;
+  default:
+    return i.p;
+  }
+}
+
+static inline void msgpack_put_uint_( std::string& x, uint64_t v )
+{
+  if( v < 0x80 ) x += (char)v;
+  else if( v <= 0xff ) msgpack_put_( x, 0xcc, v, 1 );
+  else if( v <= 0xffff ) msgpack_put_( x, 0xcd, v, 2 );
+  else if( v <= 0xffffffffu ) msgpack_put_( x, 0xce, v, 4 );
+  else msgpack_put_( x, 0xcf, v, 8 );
+}
+static inline void msgpack_put_int_( std::string& x, int64_t v )
+{
+  if( v >= 0 ) msgpack_put_uint_( x, (uint64_t)v );
+  else if( v >= -32 ) x += (char)(uint8_t)v;
+  else if( v >= -128 ) msgpack_put_( x, 0xd0, (uint64_t)v, 1 );
+  else if( v >= -32768 ) msgpack_put_( x, 0xd1, (uint64_t)v, 2 );
+  else if( v >= INT32_MIN ) msgpack_put_( x, 0xd2, (uint64_t)v, 4 );
+  else msgpack_put_( x, 0xd3, (uint64_t)v, 8 );
+}
+static inline void msgpack_put_float_( std::string& x, float v )
+{
+  uint32_t b; memcpy( &b, &v, 4 );
+  msgpack_put_( x, 0xca, b, 4 );
+}
+static inline void msgpack_put_float_( std::string& x, double v )
+{
+  uint64_t b; memcpy( &b, &v, 8 );
+  msgpack_put_( x, 0xcb, b, 8 );
+}
+// header of a str/bin/array/map of n; fix is the one byte form for n <= fix_max, tag8 0 when there is no 8 bit form
+static inline void msgpack_put_head_( std::string& x, size_t n, uint8_t fix, size_t fix_max, uint8_t tag8, uint8_t tag16, uint8_t tag32 )
+{
+  if( n <= fix_max ) x += (char)(fix | n);
+  else if( tag8 && n <= 0xff ) msgpack_put_( x, tag8, n, 1 );
+  else if( n <= 0xffff ) msgpack_put_( x, tag16, n, 2 );
+  else if( n <= 0xffffffffu ) msgpack_put_( x, tag32, n, 4 );
+  else throw std::string("msgpack: too long");
+}
+static inline void msgpack_put_str_( std::string& x, const char* _s, size_t n )
+{
+  msgpack_put_head_( x, n, 0xa0, 31, 0xd9, 0xda, 0xdb );
+  x.append( _s, n );
+}
+static inline void msgpack_put_bin_( std::string& x, const void* _s, size_t n )
+{
+  if( n <= 0xff ) msgpack_put_( x, 0xc4, n, 1 ); // no one byte form for bin
+  else msgpack_put_head_( x, n, 0, 0, 0, 0xc5, 0xc6 );
+  x.append( (const char*)_s, n );
+}
+static inline void msgpack_put_array_( std::string& x, size_t n ) { msgpack_put_head_( x, n, 0x90, 15, 0, 0xdc, 0xdd ); }
+static inline void msgpack_put_map_( std::string& x, size_t n )   { msgpack_put_head_( x, n, 0x80, 15, 0, 0xde, 0xdf ); }
+
+// Maps, arrays and flag strings counted while written start with the 32 bit header and get the count
+// when they close. Small ones switch to the one byte form, moving their few bytes back over the rest.
+enum { msgpack_shrink_max = 1024 };
+
+static inline size_t msgpack_open_( std::string& x, uint8_t tag32 )
+{
+  size_t head = x.size();
+  msgpack_put_( x, tag32, 0, 4 );
+  return head;
+}
+static inline void msgpack_close_( std::string& x, size_t head, size_t n, uint8_t fix, size_t fix_max )
+{
+  if( n > 0xffffffffu )
+    throw std::string("msgpack: too long");
+  if( n <= fix_max && x.size() - head <= msgpack_shrink_max ) {
+    x[head] = (char)(fix | n);
+    x.erase( head + 1, 4 );
+    return;
+  }
+  msgpack_set_be_( &x[head + 1], n, 4 );
+}
+
+
+/////////////////////////////////////////////////////////// MsgPackOut /////////////////////////////////////////////////////////////
+struct MsgPackOut;
+struct MsgPackOutFlags;
+struct MsgPackOutBitFields;
+struct MsgPackBin;
+
+struct MsgPackOutValue
+{
+  std::string& x;
+  MsgPackOutValue( std::string& _x ) : x(_x) {}
+
+  template< class T > void operator() ( const T& _v )
+  {
+    msgpack_write_( *this, _v, 0 );
+  }
+  template< class T, class F > void operator() ( T& _v, F _f )
+  {
+    typename F::io_stream jo(x);
+    F::io_type::template serialize(jo, _v);
+  }
+  template< class T > void operator = ( const T& _v )
+  {
+    (*this)(_v);
+  }
+};
+
+template< class T >
+static inline typename std::enable_if< std::is_integral<T>::value && std::is_signed<T>::value && !std::is_same<T, bool>::value >::type msgpack_write_( MsgPackOutValue& o, const T& _v, int _dummy )
+{
+  msgpack_put_int_( o.x, _v );
+}
+template< class T >
+static inline typename std::enable_if< std::is_integral<T>::value && !std::is_signed<T>::value && !std::is_same<T, bool>::value >::type msgpack_write_( MsgPackOutValue& o, const T& _v, int _dummy )
+{
+  msgpack_put_uint_( o.x, _v );
+}
+// by exact type, so enums do not convert
+template< class T >
+static inline typename std::enable_if< std::is_same<T, bool>::value >::type msgpack_write_( MsgPackOutValue& o, const T& _v, int _dummy )
+{
+  o.x += (char)(_v ? 0xc3 : 0xc2);
+}
+template< class T >
+static inline typename std::enable_if< std::is_floating_point<T>::value >::type msgpack_write_( MsgPackOutValue& o, const T& _v, int _dummy )
+{
+  msgpack_put_float_( o.x, (typename std::conditional< std::is_same<T, float>::value, float, double >::type)_v );
+}
+template< class T >
+static inline typename std::enable_if< json_is_str_<T>::value >::type msgpack_write_( MsgPackOutValue& o, const T& _v, int _dummy )
+{
+  strview_t s(_v);
+  msgpack_put_str_( o.x, s.data(), s.size() );
+}
+template< size_t N >
+static inline void msgpack_write_( MsgPackOutValue& o, const char (&_v)[N], int _dummy )
+{
+  msgpack_put_str_( o.x, _v, strnlen( _v, N ) );
+}
+template< class T >
+static inline typename std::enable_if< std::is_same<T, JsonOutBinX>::value >::type msgpack_write_( MsgPackOutValue& o, const T& _v, int _dummy )
+{
+  msgpack_put_bin_( o.x, _v.data(), _v.size() );
+}
+template< class T >
+static inline void msgpack_write_( MsgPackOutValue& o, const T& _v, decltype( &xio<T>::template x2s_map_<x2s_dummy> ) _dummy )
+{
+  strview_t n;
+  if( !x2s_name_( _v, &n ) )
+    throw "Unknown enum";
+  msgpack_put_str_( o.x, n.data(), n.size() );
+}
+// anything else as the text xio<T> writes
+template< class T >
+static inline void msgpack_write_( MsgPackOutValue& o, const T& _v, ... )
+{
+  std::string tmp;
+  xio<T>::Write( tmp, _v );
+  msgpack_put_str_( o.x, tmp.data(), tmp.size() );
+}
+
+template< class V >
+static inline void msgpack_write_array_( MsgPackOutValue& o, const V& _v, size_t n )
+{
+  msgpack_put_array_( o.x, n );
+  for( const auto& v : _v )
+    msgpack_write_( o, v, 0 );
+}
+template< class T, class A >
+static inline void msgpack_write_( MsgPackOutValue& o, const std::vector<T, A>& _v, int _dummy )
+{
+  msgpack_write_array_( o, _v, _v.size() );
+}
+template< class T, class A >
+static inline void msgpack_write_( MsgPackOutValue& o, const std::list<T, A>& _v, int _dummy )
+{
+  msgpack_write_array_( o, _v, _v.size() );
+}
+template< class T, size_t N >
+static inline void msgpack_write_( MsgPackOutValue& o, const std::array<T, N>& _v, int _dummy )
+{
+  msgpack_write_array_( o, _v, N );
+}
+template< class T, size_t N >
+static inline void msgpack_write_( MsgPackOutValue& o, const small_vector_t<T, N>& _v, int _dummy )
+{
+  msgpack_write_array_( o, _v, _v.size() );
+}
+template< class T, size_t N >
+static inline typename std::enable_if< !std::is_same<T, char>::value >::type msgpack_write_( MsgPackOutValue& o, const T (&_v)[N], int _dummy )
+{
+  msgpack_write_array_( o, _v, N );
+}
+template< size_t N >
+static inline void msgpack_write_( MsgPackOutValue& o, const std::bitset<N>& _v, int _dummy )
+{
+  msgpack_put_head_( o.x, N, 0xa0, 31, 0xd9, 0xda, 0xdb );
+  for( size_t i = 0; i < N; ++i )
+    o.x += _v[N - 1 - i] ? '1' : '0';
+}
+
+template< class M >
+static inline void msgpack_write_map_( MsgPackOutValue& o, const M& _m )
+{
+  msgpack_put_map_( o.x, _m.size() );
+  std::string tmp;
+  for( const auto& kv : _m ) {
+    strview_t k = json_key_text_( kv.first, tmp, 0 );
+    msgpack_put_str_( o.x, k.data(), k.size() );
+    msgpack_write_( o, kv.second, 0 );
+  }
+}
+template< class K, class V, class C, class A >
+static inline void msgpack_write_( MsgPackOutValue& o, const std::map<K, V, C, A>& _v, int _dummy )
+{
+  msgpack_write_map_( o, _v );
+}
+template< class K, class V, class H, class E, class A >
+static inline void msgpack_write_( MsgPackOutValue& o, const std::unordered_map<K, V, H, E, A>& _v, int _dummy )
+{
+  msgpack_write_map_( o, _v );
+}
+template< class K, class V, class C >
+static inline void msgpack_write_( MsgPackOutValue& o, const flat_map_t<K, V, C>& _v, int _dummy )
+{
+  msgpack_write_map_( o, _v );
+}
+
+struct MsgPackOutArray
+{
+  std::string& x;
+  size_t head;
+  size_t n;
+  MsgPackOutArray( std::string& _x ) : x(_x), head(msgpack_open_( _x, 0xdd )), n(0) {}
+  MsgPackOutArray( const MsgPackOutValue& _x ) : MsgPackOutArray(_x.x) {}
+  ~MsgPackOutArray() { msgpack_close_( x, head, n, 0x90, 15 ); }
+
+  template< class T > void operator() ( const T& _v )
+  {
+    next()( _v );
+  }
+  MsgPackOutValue next()
+  {
+    ++n;
+    return MsgPackOutValue(x);
+  }
+};
+
+// Writes into a string only: the map header is patched when the object closes.
+struct MsgPackOut
+{
+  std::string& x;
+  size_t head;
+  size_t n;
+  MsgPackOut( std::string& _x ) : x(_x), head(msgpack_open_( _x, 0xdf )), n(0) {}
+  MsgPackOut( const MsgPackOutValue& _x ) : MsgPackOut(_x.x) {}
+  ~MsgPackOut() { msgpack_close_( x, head, n, 0x80, 15 ); }
+
+  // binary as it is, whatever the json encoding
+  template< class T >
+  static JsonOutBinX Bin(const T& _v) { return JsonOutBinX(_v); }
+  static XioFunc<MsgPackBin, MsgPackOutValue> Bin() { return XioFunc<MsgPackBin, MsgPackOutValue>(); }
+  template< class T >
+  static JsonOutBinX Base64(const T& _v) { return JsonOutBinX(_v); }
+  static XioFunc<MsgPackBin, MsgPackOutValue> Base64() { return XioFunc<MsgPackBin, MsgPackOutValue>(); }
+  template< class T >
+  static JsonOutBinX Base64Url(const T& _v) { return JsonOutBinX(_v); }
+  static XioFunc<MsgPackBin, MsgPackOutValue> Base64Url() { return XioFunc<MsgPackBin, MsgPackOutValue>(); }
+  template< class F >
+  static XioFunc<F, MsgPackOutFlags> Flags(F _f) { return XioFunc<F, MsgPackOutFlags>(); }
+  static XioFunc<void, MsgPackOutFlags> Flags() { return XioFunc<void, MsgPackOutFlags>(); }
+  template< class F >
+  static XioFunc<F, MsgPackOutBitFields> BitFields(F _f) { return XioFunc<F, MsgPackOutBitFields>(); }
+  static XioFunc<void, MsgPackOutBitFields> BitFields() { return XioFunc<void, MsgPackOutBitFields>(); }
+
+  template< class T > void operator() ( const T& _v )
+  {
+    T::template serialize( *this, _v );
+  }
+
+  template< class T > void operator() ( const json_key_t& _n, const T& _v )
+  {
+    (*this)( _n )( _v );
+  }
+  template< class T, class S, class F > void operator() ( const json_key_t& _n, T& _v, XioFunc<F, S> _f )
+  {
+    (*this)( _n )( _v, _f );
+  }
+  template< class T, class S > void operator() ( const json_key_t& _n, T& _v, XioFunc<void, S> _f )
+  {
+    (*this)( _n )( _v, XioFunc<T, S>() );
+  }
+  template< class T, class X > void operator() ( const json_key_t& _n, const T& _v, xio<X> _f )
+  {
+    (*this)( _n );
+    std::string tmp;
+    X::Write( tmp, _v );
+    msgpack_put_str_( x, tmp.data(), tmp.size() );
+  }
+
+  template< size_t N >
+  MsgPackOutValue operator() ( const char (&_n)[N] )
+  {
+    return (*this)( json_key_t(_n) );
+  }
+  MsgPackOutValue operator() ( const json_key_t& _n )
+  {
+    ++n;
+    msgpack_put_str_( x, _n.name.data(), _n.name.size() );
+    return MsgPackOutValue(x);
+  }
+  MsgPackOutValue key( const strview_t& _n )
+  {
+    return (*this)( json_key_t(_n) );
+  }
+  MsgPackOutArray array( const json_key_t& _n )
+  {
+    (*this)( _n );
+    return MsgPackOutArray(x);
+  }
+  explicit operator bool() const { return true; }
+};
+
+template< class T >
+static inline void msgpack_write_( MsgPackOutValue& o, const T& _v, decltype( &T::template serialize<MsgPackOut,T> ) _dummy )
+{
+  MsgPackOut mo(o);
+  T::serialize( mo, _v );
+}
+template< class T >
+static inline void msgpack_write_( MsgPackOutValue& o, const T& _v, decltype( &xio<T>::template serialize<MsgPackOut,T> ) _dummy )
+{
+  MsgPackOut mo(o);
+  xio<T>::serialize( mo, _v );
+}
+
+// the names of the set flags, space separated, as in json
+struct MsgPackOutFlags
+{
+  std::string& x;
+  size_t head;
+  MsgPackOutFlags( std::string& _x ) : x(_x), head(msgpack_open_( _x, 0xdb )) {}
+  ~MsgPackOutFlags()
+  {
+    if( x.size() > head + 5 )
+      x.pop_back(); // the last ' '
+    msgpack_close_( x, head, x.size() - head - 5, 0xa0, 31 );
+  }
+
+  void write_flag( const char* _n, size_t _len, bool _v )
+  {
+    if( !_v )
+      return;
+    x.append( _n, _len );
+    x += ' ';
+  }
+
+  // a char buffer may hold a shorter name
+  template<class T, size_t N>
+  void operator () ( const char (&_n)[N], T _v, T _bit )
+  {
+    write_flag( _n, strnlen( _n, N ), (_v & _bit) );
+  }
+  template< class T, class Fi, size_t N >
+  void operator() ( const char (&_n)[N], T _v, Fi _fin )
+  {
+    write_flag( _n, strnlen( _n, N ), !!_v );
+  }
+  template< class C, class T, class = typename std::enable_if< std::is_same<C, const char*>::value || std::is_same<C, char*>::value >::type >
+  void operator () ( const C& _n, T _v, T _bit )
+  {
+    write_flag( _n, strlen( _n ), (_v & _bit) );
+  }
+  template< class C, class T, class Fi, class = typename std::enable_if< std::is_same<C, const char*>::value || std::is_same<C, char*>::value >::type >
+  void operator() ( const C& _n, T _v, Fi _fin )
+  {
+    write_flag( _n, strlen( _n ), !!_v );
+  }
+};
+
+struct MsgPackOutBitFields
+{
+  MsgPackOut x;
+  MsgPackOutBitFields( std::string& _x ) : x(_x) {}
+
+  template<class T>
+  void operator () ( const json_key_t& _n, T _v, T _bit )
+  {
+    x( _n )( (unsigned)!!(_v & _bit) );
+  }
+  template< class T, class Fi >
+  void operator() ( const json_key_t& _n, T _v, Fi _fin )
+  {
+    x( _n )( _v );
+  }
+};
+
+
+/////////////////////////////////////////////////////////// MsgPackIn /////////////////////////////////////////////////////////////
+struct MsgPackIn;
+struct MsgPackInFlags;
+struct MsgPackInBitFields;
+
+struct MsgPackInValue
+{
+  strview_t x; // one whole value, empty when the member was not found
+
+  MsgPackInValue() {}
+  explicit MsgPackInValue( const strview_t& _x ) : x(_x) {}
+  bool empty() const { return x.empty(); }
+
+  msgpack_item_t item() const
+  {
+    msgpack_item_t i;
+    msgpack_item_( x.data(), x.end(), &i );
+    return i;
+  }
+
+  template< class T > void operator() ( T& _v ) const
+  {
+    if( !empty() )
+      msgpack_read_( *this, _v, 0 );
+  }
+  template< class T, class F >
+  void operator() ( T& _v, F _f ) const
+  {
+    typename F::io_stream ji(*this);
+    json_bind_( ji, (typename F::io_type*)nullptr );
+    F::io_type::template serialize(ji, _v);
+  }
+};
+
+// bytes of a str or bin, null for nil or a missing value
+static inline strview_t msgpack_bytes_( const MsgPackInValue& x )
+{
+  if( x.empty() )
+    return strview_t();
+  msgpack_item_t i = x.item();
+  if( msgpack_str == i.type || msgpack_bin == i.type )
+    return strview_t( i.p, (size_t)i.u );
+  if( msgpack_nil == i.type )
+    return strview_t();
+  throw std::string("msgpack: expected a string");
+}
+
+struct MsgPackInArray
+{
+  const char* p;
+  const char* e;
+  size_t n; // items left
+  MsgPackInArray( const MsgPackInValue& _x ) : p(nullptr), e(nullptr), n(0)
+  {
+    if( _x.empty() )
+      return;
+    msgpack_item_t i = _x.item();
+    if( msgpack_nil == i.type )
+      return;
+    if( msgpack_array != i.type )
+      throw std::string("msgpack: expected an array");
+    p = i.p;
+    e = _x.x.end();
+    n = (size_t)i.u;
+  }
+  bool empty() const { return 0 == n; }
+  size_t count() const { return n; }
+  MsgPackInValue next()
+  {
+    ASSERT(!empty());
+    const char* b = p;
+    p = msgpack_skip_( p, e );
+    --n;
+    return MsgPackInValue( strview_t( b, p - b ) );
+  }
+  template< class T > bool operator() (T& _v)
+  {
+    if( empty() )
+      return false;
+    next()( _v );
+    return true;
+  }
+};
+
+// member at p: its key into *_key, p moves past its value
+static inline MsgPackInValue msgpack_member_( const char*& p, const char* e, strview_t* _key )
+{
+  msgpack_item_t k;
+  msgpack_item_( p, e, &k );
+  if( msgpack_str != k.type )
+    throw std::string("msgpack: map key is not a string");
+  *_key = strview_t( k.p, (size_t)k.u );
+  const char* v = k.p + k.u;
+  p = msgpack_skip_( v, e );
+  return MsgPackInValue( strview_t( v, p - v ) );
+}
+
+// members in order, for maps
+struct MsgPackInObject
+{
+  const char* p;
+  const char* e;
+  size_t n; // members left
+  MsgPackInObject( const MsgPackInValue& _x ) : p(nullptr), e(nullptr), n(0)
+  {
+    if( _x.empty() )
+      return;
+    msgpack_item_t i = _x.item();
+    if( msgpack_nil == i.type )
+      return;
+    if( msgpack_map != i.type )
+      throw std::string("msgpack: expected a map");
+    p = i.p;
+    e = _x.x.end();
+    n = (size_t)i.u;
+  }
+  bool empty() const { return 0 == n; }
+  size_t count() const { return n; }
+  MsgPackInValue next( strview_t* _key )
+  {
+    ASSERT(!empty());
+    --n;
+    return msgpack_member_( p, e, _key );
+  }
+};
+
+struct MsgPackBin
+{
+  template< class T >
+  static void serialize( MsgPackOutValue& s, const T& p )
+  {
+    msgpack_put_bin_( s.x, p.data(), p.size() );
+  }
+  static void serialize( const MsgPackInValue& s, std::string& p )
+  {
+    strview_t b = msgpack_bytes_( s );
+    if( !b.isnull() )
+      p.assign( b.data(), b.size() );
+  }
+};
+
+// Members are looked for from the one after the previous hit, so a map written by the same serialize()
+// is read in a single pass with one compare per member.
+struct MsgPackIn
+{
+  const char* b;   // first member
+  const char* e;   // end of the input
+  size_t n;        // members
+  const char* cur; // member after the last one found
+  size_t i_cur;
+
+  static JsonInBinS Bin(std::string& _v) { return JsonInBinS(_v); }
+  template< class T >
+  static JsonInBinX Bin(T& _v) { return JsonInBinX(_v); }
+  static XioFunc<MsgPackBin, MsgPackInValue> Bin() { return XioFunc<MsgPackBin, MsgPackInValue>(); }
+  static JsonInBinS Base64(std::string& _v) { return JsonInBinS(_v); }
+  template< class T >
+  static JsonInBinX Base64(T& _v) { return JsonInBinX(_v); }
+  static XioFunc<MsgPackBin, MsgPackInValue> Base64() { return XioFunc<MsgPackBin, MsgPackInValue>(); }
+  static JsonInBinS Base64Url(std::string& _v) { return JsonInBinS(_v); }
+  template< class T >
+  static JsonInBinX Base64Url(T& _v) { return JsonInBinX(_v); }
+  static XioFunc<MsgPackBin, MsgPackInValue> Base64Url() { return XioFunc<MsgPackBin, MsgPackInValue>(); }
+  template< class F >
+  static XioFunc<F, MsgPackInFlags> Flags(F _f) { return XioFunc<F, MsgPackInFlags>(); }
+  static XioFunc<void, MsgPackInFlags> Flags() { return XioFunc<void, MsgPackInFlags>(); }
+  template< class F >
+  static XioFunc<F, MsgPackInBitFields> BitFields(F _f) { return XioFunc<F, MsgPackInBitFields>(); }
+  static XioFunc<void, MsgPackInBitFields> BitFields() { return XioFunc<void, MsgPackInBitFields>(); }
+
+  MsgPackIn( const MsgPackInValue& _x ) : b(nullptr), e(nullptr), n(0), cur(nullptr), i_cur(0)
+  {
+    MsgPackInObject o( _x );
+    b = cur = o.p;
+    e = o.e;
+    n = o.n;
+  }
+  MsgPackIn( const strview_t& _x ) : MsgPackIn( MsgPackInValue(_x) ) {}
+  MsgPackIn( const std::string& _x ) : MsgPackIn( MsgPackInValue(strview_t(_x)) ) {}
+
+  template< class T > bool operator() ( T& _v ) const
+  {
+    T::template serialize( *this, _v );
+    return true;
+  }
+
+  template< class T > void operator() ( const json_key_t& _n, T& _v )
+  {
+    (this->get(_n))( _v );
+  }
+  void operator() ( const json_key_t& _n, JsonInBinS _v )
+  {
+    strview_t s = msgpack_bytes_( get(_n) );
+    if( !s.isnull() )
+      _v.v.assign( s.data(), s.size() );
+  }
+  void operator() ( const json_key_t& _n, JsonInBinX _v )
+  {
+    strview_t s = msgpack_bytes_( get(_n) );
+    if( s.size() == _v.v_size ) // left as it was on a size mismatch
+      memcpy( _v.v_data, s.data(), s.size() );
+  }
+  template< class T, class S, class F >
+  void operator() ( const json_key_t& _n, T& _v, XioFunc<F, S> _f )
+  {
+    (this->get(_n))( _v, _f );
+  }
+  template< class T, class S >
+  void operator() ( const json_key_t& _n, T& _v, XioFunc<void, S> _f )
+  {
+    (this->get(_n))( _v, XioFunc<T, S>() );
+  }
+  template< class T, class X >
+  void operator() ( const json_key_t& _n, T& _v, xio<X> _f )
+  {
+    strview_t s = msgpack_bytes_( get(_n) );
+    if( !s.isnull() )
+      X::Read( s, _v );
+  }
+
+  MsgPackInValue get( const json_key_t& _n )
+  {
+    const char* p = cur;
+    size_t i = i_cur;
+    for( size_t left = n; left; --left, ++i ) {
+      if( i == n ) {
+        p = b;
+        i = 0;
+      }
+      strview_t k;
+      MsgPackInValue v = msgpack_member_( p, e, &k );
+      if( _n.name.equal( k.data(), k.size() ) ) {
+        cur = p;
+        i_cur = i + 1;
+        return v;
+      }
+    }
+    return MsgPackInValue();
+  }
+
+  template< size_t N >
+  MsgPackInValue operator() ( const char (&_n)[N] )
+  {
+    return get( _n );
+  }
+
+  explicit operator bool() const { return true; }
+};
+
+// same flag strings as json, so the learned json_flags_t table of the type is shared
+struct MsgPackInFlags : JsonInFlags
+{
+  MsgPackInFlags( const MsgPackInValue& _x ) : JsonInFlags( msgpack_bytes_( _x ) ) {}
+};
+template< class T >
+static inline void json_bind_( MsgPackInFlags& _s, T* _dummy ) { _s.bind( json_flags_t::of<T>() ); }
+
+struct MsgPackInBitFields
+{
+  MsgPackIn x;
+  MsgPackInBitFields( const MsgPackInValue& _x ) : x(_x) {}
+
+  template<class T>
+  void operator () ( const json_key_t& _n, T& _v, T _bit )
+  {
+    unsigned v = 0;
+    (x.get(_n))( v );
+    if( v ) _v |= _bit; // set bit
+    else _v &= ~_bit; // clear bit
+  }
+
+  template< class T, class Fi >
+  void operator() ( const json_key_t& _n, const T& _v, Fi _fin )
+  {
+    unsigned v = 0;
+    (x.get(_n))( v );
+    _fin(v);
+  }
+};
+
+template< class T >
+static inline typename std::enable_if< std::is_integral<T>::value && !std::is_same<T, bool>::value, bool >::type msgpack_read_( const MsgPackInValue& x, T& _v, int _dummy )
+{
+  msgpack_item_t i = x.item();
+  if( msgpack_nil == i.type )
+    return false;
+  if( msgpack_int == i.type && (int64_t)i.u < 0 ) {
+    if( std::is_unsigned<T>::value || (int64_t)i.u < (int64_t)std::numeric_limits<T>::min() )
+      throw std::string("msgpack: integer out of range");
+    _v = (T)(int64_t)i.u;
+    return true;
+  }
+  if( msgpack_int != i.type && msgpack_uint != i.type )
+    throw std::string("msgpack: expected an integer");
+  if( i.u > (uint64_t)std::numeric_limits<T>::max() )
+    throw std::string("msgpack: integer out of range");
+  _v = (T)i.u;
+  return true;
+}
+template< class T >
+static inline typename std::enable_if< std::is_floating_point<T>::value, bool >::type msgpack_read_( const MsgPackInValue& x, T& _v, int _dummy )
+{
+  msgpack_item_t i = x.item();
+  switch( i.type ) {
+  case msgpack_float: _v = (T)i.d; return true;
+  case msgpack_uint: _v = (T)i.u; return true;
+  case msgpack_int: _v = (T)(int64_t)i.u; return true;
+  case msgpack_nil: return false;
+  }
+  throw std::string("msgpack: expected a number");
+}
+template< class T >
+static inline typename std::enable_if< std::is_same<T, bool>::value, bool >::type msgpack_read_( const MsgPackInValue& x, T& _v, int _dummy )
+{
+  msgpack_item_t i = x.item();
+  if( msgpack_nil == i.type )
+    return false;
+  if( msgpack_bool != i.type )
+    throw std::string("msgpack: expected a bool");
+  _v = 0 != i.u;
+  return true;
+}
+template< class Tr, class A >
+static inline bool msgpack_read_( const MsgPackInValue& x, std::basic_string<char, Tr, A>& _v, int _dummy )
+{
+  strview_t s = msgpack_bytes_( x );
+  if( s.isnull() )
+    return false;
+  _v.assign( s.data(), s.size() );
+  return true;
+}
+// points into the input, which has no escapes to undo
+static inline bool msgpack_read_( const MsgPackInValue& x, strview_t& _v, int _dummy )
+{
+  strview_t s = msgpack_bytes_( x );
+  if( s.isnull() )
+    return false;
+  _v = s;
+  return true;
+}
+template< size_t N >
+static inline bool msgpack_read_( const MsgPackInValue& x, char (&_v)[N], int _dummy )
+{
+  strview_t s = msgpack_bytes_( x );
+  if( s.isnull() || N <= s.size() )
+    return false;
+  memcpy( _v, s.data(), s.size() );
+  _v[s.size()] = 0;
+  return true;
+}
+template< class T >
+static inline bool msgpack_read_( const MsgPackInValue& x, T& _v, decltype( &T::template serialize<MsgPackIn,T> ) _dummy )
+{
+  MsgPackIn mi(x);
+  T::serialize( mi, _v );
+  return true;
+}
+template< class T >
+static inline bool msgpack_read_( const MsgPackInValue& x, T& _v, decltype( &xio<T>::template serialize<MsgPackIn,T> ) _dummy )
+{
+  MsgPackIn mi(x);
+  xio<T>::serialize( mi, _v );
+  return true;
+}
+// enums, bitsets and anything xio<T> reads: from their text, as json does
+template< class T >
+static inline bool msgpack_read_( const MsgPackInValue& x, T& _v, ... )
+{
+  strview_t s = msgpack_bytes_( x );
+  if( s.isnull() )
+    return false;
+  JsonInValue jv(s);
+  jv( _v );
+  return true;
+}
+
+template< class T >
+static inline bool msgpack_read_list_( const MsgPackInValue& x, T& _v )
+{
+  MsgPackInArray a( x );
+  _v.clear();
+  json_reserve_( a, _v, 0 );
+  while( !a.empty() ) {
+    _v.emplace_back();
+    a.next()( _v.back() );
+  }
+  return true;
+}
+template< class T, class A >
+static inline bool msgpack_read_( const MsgPackInValue& x, std::vector<T, A>& _v, int _dummy )
+{
+  return msgpack_read_list_( x, _v );
+}
+template< class T, class A >
+static inline bool msgpack_read_( const MsgPackInValue& x, std::list<T, A>& _v, int _dummy )
+{
+  return msgpack_read_list_( x, _v );
+}
+template< class T, size_t N >
+static inline bool msgpack_read_( const MsgPackInValue& x, small_vector_t<T, N>& _v, int _dummy )
+{
+  return msgpack_read_list_( x, _v );
+}
+template< class A >
+static inline bool msgpack_read_( const MsgPackInValue& x, std::vector<bool, A>& _v, int _dummy )
+{
+  MsgPackInArray a( x );
+  _v.clear();
+  _v.reserve( a.count() );
+  while( !a.empty() ) {
+    bool v = false;
+    a.next()( v );
+    _v.push_back( v );
+  }
+  return true;
+}
+template< class T >
+static inline bool msgpack_read_fixed_( const MsgPackInValue& x, T* _v, size_t N )
+{
+  MsgPackInArray a( x );
+  if( a.count() > N )
+    throw std::string("too many items for a fixed size array");
+  for( size_t i = 0; !a.empty(); ++i )
+    a.next()( _v[i] );
+  return true;
+}
+template< class T, size_t N >
+static inline bool msgpack_read_( const MsgPackInValue& x, std::array<T, N>& _v, int _dummy )
+{
+  return msgpack_read_fixed_( x, _v.data(), N );
+}
+template< class T, size_t N >
+static inline typename std::enable_if< !std::is_same<T, char>::value, bool >::type msgpack_read_( const MsgPackInValue& x, T (&_v)[N], int _dummy )
+{
+  return msgpack_read_fixed_( x, _v, N );
+}
+
+// map keys: strings as they are, anything else from its text
+template< class Tr, class A >
+static inline void msgpack_read_key_( const strview_t& k, std::basic_string<char, Tr, A>& _v )
+{
+  _v.assign( k.data(), k.size() );
+}
+static inline void msgpack_read_key_( const strview_t& k, strview_t& _v )
+{
+  _v = k;
+}
+template< class K >
+static inline void msgpack_read_key_( const strview_t& k, K& _v )
+{
+  JsonInValue kv( k );
+  kv( _v );
+}
+// a later duplicate key overwrites, like in json
+template< class M >
+static inline bool msgpack_read_map_( const MsgPackInValue& x, M& _m )
+{
+  MsgPackInObject o( x );
+  _m.clear();
+  json_reserve_( o, _m, 0 );
+  strview_t k;
+  while( !o.empty() ) {
+    MsgPackInValue v = o.next( &k );
+    typename M::key_type kv;
+    msgpack_read_key_( k, kv );
+    v( _m[std::move(kv)] );
+  }
+  return true;
+}
+template< class K, class V, class C, class A >
+static inline bool msgpack_read_( const MsgPackInValue& x, std::map<K, V, C, A>& _v, int _dummy )
+{
+  return msgpack_read_map_( x, _v );
+}
+template< class K, class V, class H, class E, class A >
+static inline bool msgpack_read_( const MsgPackInValue& x, std::unordered_map<K, V, H, E, A>& _v, int _dummy )
+{
+  return msgpack_read_map_( x, _v );
+}
+template< class K, class V, class C >
+static inline bool msgpack_read_( const MsgPackInValue& x, flat_map_t<K, V, C>& _v, int _dummy )
+{
+  MsgPackInObject o( x );
+  _v.clear();
+  _v.reserve( o.count() );
+  strview_t k;
+  while( !o.empty() ) {
+    MsgPackInValue v = o.next( &k );
+    typename flat_map_t<K, V, C>::value_type& item = _v.emplace_back_unsorted();
+    msgpack_read_key_( k, item.first );
+    v( item.second );
+  }
+  _v.sort();
+  return true;
+}
+
+
+#endif // __MSGPACKIO_H
@@ -0,0 +1,148 @@
+#ifndef __SMALL_VECTOR_H
+#define __SMALL_VECTOR_H
+
+#include <new>
+#include <utility>
+#include <initializer_list>
+
+
+// Vector keeping up to N items inline, on the heap only when it grows past that.
+// Same interface as the parts of std::vector jsonio uses; items move when it spills.
+template< class T, size_t N >
+struct small_vector_t
+{
+  static_assert( N > 0, "small_vector_t needs inline room" );
+  typedef T value_type;
+  typedef T* iterator;
+  typedef const T* const_iterator;
+  typedef size_t size_type;
+
+  small_vector_t() : b((T*)buf), n(0), cap(N) {}
+  small_vector_t( std::initializer_list<T> _l ) : small_vector_t() { reserve( _l.size() ); for( const T& v : _l ) push_back( v ); }
+  small_vector_t( const small_vector_t& _x ) : small_vector_t() { reserve( _x.n ); for( const T& v : _x ) push_back( v ); }
+  small_vector_t( small_vector_t&& _x ) : small_vector_t() { take_( _x ); }
+  ~small_vector_t() { clear(); free_(); }
+
+  small_vector_t& operator = ( const small_vector_t& _x )
+  {
+    if( this != &_x ) {
+      clear();
+      reserve( _x.n );
+      for( const T& v : _x ) push_back( v );
+    }
+    return *this;
+  }
+  small_vector_t& operator = ( small_vector_t&& _x )
+  {
+    if( this != &_x ) {
+      clear();
+      free_();
+      take_( _x );
+    }
+    return *this;
+  }
+
+  size_t size() const     { return n; }
+  size_t capacity() const { return cap; }
+  bool   empty() const    { return 0 == n; }
+  bool   is_inline() const { return b == (const T*)buf; }
+
+  T*       data()        { return b; }
+  const T* data() const  { return b; }
+  T*       begin()       { return b; }
+  T*       end()         { return b + n; }
+  const T* begin() const { return b; }
+  const T* end() const   { return b + n; }
+
+  T&       operator [] ( size_t i )       { ASSERT( i < n ); return b[i]; }
+  const T& operator [] ( size_t i ) const { ASSERT( i < n ); return b[i]; }
+  T&       front()       { ASSERT( n ); return b[0]; }
+  const T& front() const { ASSERT( n ); return b[0]; }
+  T&       back()        { ASSERT( n ); return b[n - 1]; }
+  const T& back() const  { ASSERT( n ); return b[n - 1]; }
+
+  void reserve( size_t _cap )
+  {
+    if( _cap <= cap )
+      return;
+    move_to_( (T*)::operator new( _cap * sizeof(T) ), _cap, 0 );
+  }
+
+  template< class... A >
+  T& emplace_back( A&&... _a )
+  {
+    if( n < cap ) {
+      new (b + n) T( std::forward<A>(_a)... );
+      return b[n++];
+    }
+    // build the new item before the old ones move: _a may refer to one of them
+    size_t c = 2 * cap > 4 ? 2 * cap : 4;
+    T* p = (T*)::operator new( c * sizeof(T) );
+    try { new (p + n) T( std::forward<A>(_a)... ); }
+    catch( ... ) { ::operator delete( p ); throw; }
+    move_to_( p, c, 1 );
+    return b[n++];
+  }
+  void push_back( const T& _v ) { emplace_back( _v ); }
+  void push_back( T&& _v )      { emplace_back( std::move(_v) ); }
+  void pop_back()               { ASSERT( n ); b[--n].~T(); }
+
+  void resize( size_t _n )
+  {
+    reserve( _n );
+    while( n > _n ) pop_back();
+    while( n < _n ) emplace_back();
+  }
+  void clear()
+  {
+    while( n ) pop_back();
+  }
+
+private:
+  T* b;
+  size_t n;
+  size_t cap;
+  alignas(T) char buf[N * sizeof(T)];
+
+  void free_()
+  {
+    if( !is_inline() )
+      ::operator delete( b );
+    b = (T*)buf;
+    cap = N;
+  }
+  // items into p, which holds _extra more after them; if that throws, p is freed and this is as it was
+  void move_to_( T* p, size_t _cap, size_t _extra )
+  {
+    size_t i = 0;
+    try {
+      for( ; i < n; ++i )
+        new (p + i) T( std::move_if_noexcept(b[i]) );
+    }
+    catch( ... ) {
+      while( i ) p[--i].~T();
+      for( size_t k = 0; k < _extra; ++k ) p[n + k].~T();
+      ::operator delete( p );
+      throw;
+    }
+    for( i = 0; i < n; ++i )
+      b[i].~T();
+    free_();
+    b = p;
+    cap = _cap;
+  }
+  // into an empty inline this
+  void take_( small_vector_t& _x )
+  {
+    if( _x.is_inline() ) {
+      for( T& v : _x ) push_back( std::move(v) );
+      _x.clear();
+      return;
+    }
+    b = _x.b; n = _x.n; cap = _x.cap;
+    _x.b = (T*)_x.buf; _x.n = 0; _x.cap = N;
+  }
+};
+
+
+#endif // __SMALL_VECTOR_H
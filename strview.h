@@ -84,7 +84,21 @@ struct strview_t
     }
     return true;
   }
-  bool split_by( const char c, strview_t* before, strview_t* after ) const { return split_by( isch_t(c), before, after ); }
+  bool split_by( const char c, strview_t* before, strview_t* after ) const
+  {
+    const char* p = empty() ? nullptr : (const char*)memchr( sv_data, c, size() );
+    if( !p )
+      return false;
+    if( before ) {
+      before->sv_data = sv_data;
+      before->sv_endp = p;
+    }
+    if( after ) {
+      after->sv_data = p + 1;
+      after->sv_endp = sv_endp;
+    }
+    return true;
+  }
 
   template< class F >
   strview_t trim_before( F _delim )
@@ -95,7 +109,7 @@ struct strview_t
     this->sv_data = r.sv_endp;
     return r;
   }
-  strview_t trim_before( const char c ) { return trim_before( isch_t(c) ); }
+  strview_t trim_before( const char c ) { return trim_before<char>( c ); }
 
   template< class F >
   strview_t trim_after( F _delim )
@@ -106,7 +120,7 @@ struct strview_t
     this->sv_endp = r.sv_data;
     return r;
   }
-  strview_t trim_after( const char c ) { return trim_after( isch_t(c) ); }
+  strview_t trim_after( const char c ) { return trim_after<char>( c ); }
 };
 
 struct strview_c_str_t